@@ -4,6 +4,21 @@ namespace DSViz {
 
 App::App() : controller_{&model_} { ConnectPorts(); }
 
+bool App::Listen(const QString &name) {
+  server_ = std::make_unique<Server>(&model_);
+  // запросы окна и сокета не должны вкладываться друг в друга: пока идет
+  // запрос клиента, кнопки окна выключены, а пришедшее во время анимации окна
+  // сервер выполняет, когда она закончится. Через очередь, чтобы посреди
+  // нагрузки (RunWorkload) сервер не влезал между запросами окна
+  QObject::connect(&view_, &View::Idle, server_.get(), &Server::Resume,
+                   Qt::QueuedConnection);
+  QObject::connect(server_.get(), &Server::Executing, &view_,
+                   &View::OnRemote);
+  return server_->Listen(name);
+}
+
+void App::Profile(Profiler *profiler) { model_.SetProfiler(profiler); }
+
 void App::ConnectPorts() {
   model_.SubscribeToBareTree(view_.GetPortIn());
   view_.SubscribeToUserInput(controller_.GetPortIn());
@@ -3,6 +3,9 @@
 #include "Core/controller.h"
 #include "Core/model.h"
 #include "Core/view.h"
+#include "Debug/perf.h"
+#include "Remote/server.h"
+#include <memory>
 
 namespace DSViz {
 
@@ -10,6 +13,11 @@ class App {
 public:
   App();
 
+  // открывает локальный сокет для внешних клиентов (см. Server)
+  bool Listen(const QString &name);
+  // счетчики процессора по операциям окна и сервера (см. Profiler)
+  void Profile(Profiler *profiler);
+
 private:
   void ConnectPorts();
 
@@ -17,6 +25,7 @@ private:
   Model model_ = {};
   View view_ = {};
   Controller controller_;
+  std::unique_ptr<Server> server_;
 };
 
 } // namespace DSViz
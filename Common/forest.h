@@ -0,0 +1,46 @@
+#ifndef FOREST_H
+#define FOREST_H
+#include "Common/query.h"
+#include <map>
+#include <sstream>
+#include <string>
+
+namespace DSViz {
+
+// команда леса link-cut в текстовом виде (строка в GUI):
+//
+//   link <u> <v> | cut <u> <v> | root <v> | connected <u> <v> | path <u> <v>
+//
+// u и v - номера вершин леса, вершина появляется при первом упоминании
+inline bool ParseForestQuery(const std::string &spec, UserQuery<int> *query) {
+  static const std::map<std::string, QueryType> kCommands = {
+      {"link", QueryType::link},
+      {"cut", QueryType::cut},
+      {"root", QueryType::find_root},
+      {"connected", QueryType::connected},
+      {"path", QueryType::path}};
+
+  std::istringstream stream{spec};
+  std::string cmd;
+  if (!(stream >> cmd)) {
+    return false;
+  }
+  auto it = kCommands.find(cmd);
+  if (it == kCommands.end()) {
+    return false;
+  }
+  UserQuery<int> res{it->second, {0, 0}};
+  bool ok = static_cast<bool>(stream >> res.args.first);
+  if (ok && res.type != QueryType::find_root) {
+    ok = static_cast<bool>(stream >> res.args.second);
+  }
+  std::string rest;
+  if (!ok || (stream >> rest && rest.front() != '#')) {
+    return false;
+  }
+  *query = std::move(res);
+  return true;
+}
+
+} // namespace DSViz
+#endif // FOREST_H
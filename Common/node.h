@@ -35,6 +35,38 @@ enum class MsgCode {
   merge_empty,
   merge_end,
   split_succ,
+  batch_done,
+  undo_done,
+  redo_done,
+  undo_empty,
+  redo_empty,
+  frozen,
+  policy_set,
+  mode_err,
+  index_err,
+  seq_mode,
+  push_perf,
+  range_perf,
+  vertex_err,
+  link_err,
+  cut_err,
+  forest_root,
+  connected,
+  disconnected,
+  path_done,
+  range_err,
+  range_empty,
+  extract_done,
+  erase_done,
+  neighbour,
+  load_done,
+  trace_on,
+  trace_off,
+  trace_empty,
+  optimal_done,
+  heat_set,
+  heat_on,
+  heat_off,
   empty_msg
 };
 
@@ -57,13 +89,22 @@ enum class State {
   split_left,
   split_right,
   inserted,
-  new_root
+  new_root,
+  push_tag
 };
 
 template <typename T> struct Node {
   Node<T> *par, *left, *right;
   T value, min, max;
-  State state = State::regular;
+  // id дерева, корнем которого является вершина. Актуален только для корня
+  int tree_id = -1;
+  // размер поддерева, по нему считаются позиции в режиме последовательности
+  int size = 1;
+  // отложенные разворот и прибавка для режима последовательности. Сама
+  // вершина (value, min, max, порядок детей) их уже учитывает, отложены они
+  // только для поддеревьев детей
+  bool rev = false;
+  int add = 0;
 };
 
 } // namespace DSViz
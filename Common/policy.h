@@ -0,0 +1,77 @@
+#ifndef POLICY_H
+#define POLICY_H
+#include <sstream>
+#include <string>
+
+namespace DSViz {
+
+// как поиск (find) перестраивает дерево. Остальные операции всегда сплеят
+// до корня, им это нужно для корректности (split, merge и т.д.)
+struct SplayPolicy {
+  enum class Kind {
+    // обычный splay до корня
+    full,
+    // semi-splay: в случае zig-zig поворачивается только родитель, и подъем
+    // продолжается от него, так что путь укорачивается примерно вдвое, а
+    // найденная вершина до корня не доезжает
+    semi,
+    // splay только если вершина глубже depth
+    depth,
+    // splay с вероятностью probability
+    random,
+    // без splay: поиск - обычный спуск по BST, дерево не меняется
+    none
+  };
+
+  Kind kind = Kind::full;
+  int depth = 0;
+  double probability = 1.0;
+
+  // full | semi | depth <k> | random <p> | none
+  static bool Parse(const std::string &spec, SplayPolicy *policy) {
+    std::istringstream stream{spec};
+    std::string name;
+    if (!(stream >> name)) {
+      return false;
+    }
+    SplayPolicy res;
+    if (name == "full") {
+      res.kind = Kind::full;
+    } else if (name == "semi") {
+      res.kind = Kind::semi;
+    } else if (name == "depth") {
+      res.kind = Kind::depth;
+      if (!(stream >> res.depth) || res.depth < 0) {
+        return false;
+      }
+    } else if (name == "none") {
+      res.kind = Kind::none;
+    } else if (name == "random") {
+      res.kind = Kind::random;
+      if (!(stream >> res.probability) || res.probability < 0 ||
+          res.probability > 1) {
+        return false;
+      }
+    } else {
+      return false;
+    }
+    std::string rest;
+    if (stream >> rest && rest.front() != '#') {
+      return false;
+    }
+    *policy = res;
+    return true;
+  }
+};
+
+// счетчики поисков в одном дереве с момента установки политики. saved -
+// сколько поворотов сэкономлено по сравнению с полным splay (он делает ровно
+// столько поворотов, какова глубина найденной вершины)
+struct SplayStats {
+  long long finds = 0;
+  long long rotations = 0;
+  long long saved = 0;
+};
+
+} // namespace DSViz
+#endif // POLICY_H
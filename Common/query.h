@@ -1,6 +1,9 @@
 #ifndef QUERY_H
 #define QUERY_H
+#include "Common/policy.h"
+#include <memory>
 #include <utility>
+#include <vector>
 
 namespace DSViz {
 
@@ -11,12 +14,74 @@ enum class QueryType {
   split,
   merge,
   deltree,
+  batch,
+  undo,
+  redo,
+  freeze,
+  policy,
+  seq_make,
+  seq_insert,
+  seq_erase,
+  seq_split,
+  seq_reverse,
+  seq_add,
+  link,
+  cut,
+  find_root,
+  connected,
+  path,
+  // find без splay, дерево не перестраивается
+  peek,
+  // ключи из [range.first, range.second] в новое дерево / удалить
+  range_extract,
+  range_erase,
+  // соседний ключ (см. Model::LowerBound и т.д.)
+  lower_bound,
+  upper_bound,
+  successor,
+  predecessor,
+  // ключи из keys в дерево args.first (-1 - в новое), см. Model::Load
+  load,
+  // запись поисков: args.second = 1 - начать, 0 - остановить
+  trace,
+  // статическое дерево по записи (см. Model::BuildOptimal)
+  optimal,
+  // затухание счетчиков обращений: args.second - период полураспада в
+  // обращениях, 0 - без затухания (см. HeatClock)
+  heat,
+  // тепловая карта: args.second = 1 - считать обращения, 0 - перестать и
+  // забыть веса
+  heat_map,
   do_nothing
 };
 
+// запросы к лесу link-cut: args - это номера вершин, а не id дерева
+inline bool IsForestQuery(QueryType type) {
+  return type == QueryType::link || type == QueryType::cut ||
+         type == QueryType::find_root || type == QueryType::connected ||
+         type == QueryType::path;
+}
+
 template <typename T> struct UserQuery {
   QueryType type;
   std::pair<int, T> args;
+  // только для batch: запросы пакета и то, какой по счету промежуточный кадр
+  // отправлять (0 - никакой, будет только итоговый кадр)
+  std::vector<UserQuery<T>> batch = {};
+  int sample = 0;
+  // только для policy
+  SplayPolicy policy = {};
+  // только для seq_*: позиция в range.first (insert, erase, split) или
+  // полуинтервал позиций [range.first, range.second) (reverse, add). Значение
+  // для insert и прибавка для add лежат в args.second. Для range_* - отрезок
+  // ключей [range.first, range.second]
+  std::pair<int, int> range = {};
+  // только для load: ключи по возрастанию без повторов. Их бывают десятки
+  // миллионов, а запрос копируется по дороге, поэтому вектор общий
+  std::shared_ptr<const std::vector<int>> keys = {};
+  // только для запросов к лесу: нужны ли промежуточные кадры (см.
+  // Model::Link)
+  bool animate = false;
 };
 
 } // namespace DSViz
@@ -0,0 +1,35 @@
+#ifndef RANGE_H
+#define RANGE_H
+#include "Common/query.h"
+#include <sstream>
+#include <string>
+
+namespace DSViz {
+
+// команда над отрезком ключей в текстовом виде (строка в GUI и строка range в
+// сценарии):
+//
+//   extract <l> <r> | erase <l> <r>
+//
+// отрезок [l, r] закрытый с обеих сторон
+inline bool ParseRangeQuery(const std::string &spec, int id,
+                            UserQuery<int> *query) {
+  std::istringstream stream{spec};
+  std::string cmd;
+  if (!(stream >> cmd) || (cmd != "extract" && cmd != "erase")) {
+    return false;
+  }
+  UserQuery<int> res{cmd == "extract" ? QueryType::range_extract
+                                      : QueryType::range_erase,
+                     {id, 0}};
+  std::string rest;
+  if (!(stream >> res.range.first >> res.range.second) ||
+      (stream >> rest && rest.front() != '#')) {
+    return false;
+  }
+  *query = std::move(res);
+  return true;
+}
+
+} // namespace DSViz
+#endif // RANGE_H
@@ -0,0 +1,62 @@
+#ifndef SEQUENCE_H
+#define SEQUENCE_H
+#include "Common/query.h"
+#include <map>
+#include <sstream>
+#include <string>
+
+namespace DSViz {
+
+// команда режима последовательности в текстовом виде (строка в GUI и строка
+// seq в сценарии):
+//
+//   make | insert <i> <value> | erase <i> | split <i> | reverse <l> <r> |
+//   add <l> <r> <delta>
+//
+// позиции считаются с нуля, отрезки полуоткрытые
+inline bool ParseSequenceQuery(const std::string &spec, int id,
+                               UserQuery<int> *query) {
+  static const std::map<std::string, QueryType> kCommands = {
+      {"make", QueryType::seq_make},       {"insert", QueryType::seq_insert},
+      {"erase", QueryType::seq_erase},     {"split", QueryType::seq_split},
+      {"reverse", QueryType::seq_reverse}, {"add", QueryType::seq_add}};
+
+  std::istringstream stream{spec};
+  std::string cmd;
+  if (!(stream >> cmd)) {
+    return false;
+  }
+  auto it = kCommands.find(cmd);
+  if (it == kCommands.end()) {
+    return false;
+  }
+  UserQuery<int> res{it->second, {id, 0}};
+  bool ok = true;
+  switch (res.type) {
+  case QueryType::seq_insert:
+    ok = static_cast<bool>(stream >> res.range.first >> res.args.second);
+    break;
+  case QueryType::seq_erase:
+  case QueryType::seq_split:
+    ok = static_cast<bool>(stream >> res.range.first);
+    break;
+  case QueryType::seq_reverse:
+    ok = static_cast<bool>(stream >> res.range.first >> res.range.second);
+    break;
+  case QueryType::seq_add:
+    ok = static_cast<bool>(stream >> res.range.first >> res.range.second >>
+                           res.args.second);
+    break;
+  default:
+    break;
+  }
+  std::string rest;
+  if (!ok || (stream >> rest && rest.front() != '#')) {
+    return false;
+  }
+  *query = std::move(res);
+  return true;
+}
+
+} // namespace DSViz
+#endif // SEQUENCE_H
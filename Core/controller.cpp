@@ -1,4 +1,6 @@
 #include "controller.h"
+#include "Debug/log.h"
+#include "Debug/perf.h"
 
 namespace DSViz {
 
@@ -13,53 +15,239 @@ Controller::Controller(Model *model)
 
 Observer<Controller::UserQuery> *Controller::GetPortIn() { return &port_in_; }
 
-void Controller::Insert(const ArgsType &args) {
-  model_ptr_->Insert(args.first, args.second);
+MsgCode Controller::Insert(const ArgsType &args) {
+  return model_ptr_->Insert(args.first, args.second);
 }
 
-void Controller::Remove(const ArgsType &args) {
-  model_ptr_->Remove(args.first, args.second);
+MsgCode Controller::Remove(const ArgsType &args) {
+  return model_ptr_->Remove(args.first, args.second);
 }
 
-void Controller::Find(const ArgsType &args) {
-  model_ptr_->ExistKey(args.first, args.second);
+MsgCode Controller::Find(const ArgsType &args) {
+  return model_ptr_->ExistKey(args.first, args.second);
 }
 
-void Controller::Split(const ArgsType &args) {
-  model_ptr_->Split(args.first, args.second);
+MsgCode Controller::Peek(const ArgsType &args) {
+  return model_ptr_->ExistKey(args.first, args.second, false);
 }
 
-void Controller::Merge(const ArgsType &args) {
-  model_ptr_->Merge(args.first, args.second);
+MsgCode Controller::Split(const ArgsType &args) {
+  return model_ptr_->Split(args.first, args.second);
 }
 
-void Controller::DeleteTree(const ArgsType &args) {
-  model_ptr_->DeleteTree(args.first);
+MsgCode Controller::Merge(const ArgsType &args) {
+  return model_ptr_->Merge(args.first, args.second);
 }
 
-void Controller::HandleMsg(const UserQuery &data) {
+MsgCode Controller::DeleteTree(const ArgsType &args) {
+  return model_ptr_->DeleteTree(args.first);
+}
+
+MsgCode Controller::Freeze(const ArgsType &args) {
+  return model_ptr_->Freeze(args.first);
+}
+
+MsgCode Controller::SetPolicy(const UserQuery &data) {
+  return model_ptr_->SetPolicy(data.args.first, data.policy);
+}
+
+MsgCode Controller::Sequence(const UserQuery &data) {
+  auto id = data.args.first;
+  auto [l, r] = data.range;
+  switch (data.type) {
+  case QueryType::seq_make:
+    return model_ptr_->MakeSequence(id);
+  case QueryType::seq_insert:
+    return model_ptr_->InsertAt(id, l, data.args.second);
+  case QueryType::seq_erase:
+    return model_ptr_->EraseAt(id, l);
+  case QueryType::seq_split:
+    return model_ptr_->SplitAt(id, l);
+  case QueryType::seq_reverse:
+    return model_ptr_->Reverse(id, l, r);
+  case QueryType::seq_add:
+    return model_ptr_->AddRange(id, l, r, data.args.second);
+  default:
+    return MsgCode::empty_msg;
+  }
+}
+
+MsgCode Controller::Range(const UserQuery &data) {
+  auto id = data.args.first;
+  auto [l, r] = data.range;
+  if (data.type == QueryType::range_extract) {
+    return model_ptr_->ExtractRange(id, l, r);
+  }
+  return model_ptr_->EraseRange(id, l, r);
+}
+
+MsgCode Controller::Bound(const UserQuery &data) {
+  auto [id, key] = data.args;
+  switch (data.type) {
+  case QueryType::lower_bound:
+    return model_ptr_->LowerBound(id, key);
+  case QueryType::upper_bound:
+    return model_ptr_->UpperBound(id, key);
+  case QueryType::successor:
+    return model_ptr_->Successor(id, key);
+  case QueryType::predecessor:
+    return model_ptr_->Predecessor(id, key);
+  default:
+    return MsgCode::empty_msg;
+  }
+}
+
+MsgCode Controller::Load(const UserQuery &data) {
+  if (!data.keys) {
+    return model_ptr_->Load(data.args.first, {});
+  }
+  return model_ptr_->Load(data.args.first, *data.keys);
+}
+
+MsgCode Controller::Forest(const UserQuery &data) {
+  auto [u, v] = data.args;
+  bool animate = data.animate;
+  switch (data.type) {
+  case QueryType::link:
+    return model_ptr_->Link(u, v, animate);
+  case QueryType::cut:
+    return model_ptr_->Cut(u, v, animate);
+  case QueryType::find_root:
+    return model_ptr_->FindRoot(u, animate);
+  case QueryType::connected:
+    return model_ptr_->Connected(u, v, animate);
+  case QueryType::path:
+    return model_ptr_->PathAggregate(u, v, animate);
+  default:
+    return MsgCode::empty_msg;
+  }
+}
+
+MsgCode Controller::Undo() { return model_ptr_->Undo(); }
+
+MsgCode Controller::Redo() { return model_ptr_->Redo(); }
+
+void Controller::Batch(const UserQuery &data) {
+  std::vector<MsgCode> results;
+  results.reserve(data.batch.size());
+  std::vector<int> keys;
+  model_ptr_->BeginBatch(data.sample);
+  for (size_t i = 0; i < data.batch.size(); ++i) {
+    auto &query = data.batch[i];
+    if (query.type == QueryType::find) {
+      size_t end = i;
+      keys.clear();
+      for (; end < data.batch.size() &&
+             data.batch[end].type == QueryType::find &&
+             data.batch[end].args.first == query.args.first;
+           ++end) {
+        keys.push_back(data.batch[end].args.second);
+      }
+      results.resize(i + keys.size());
+      if (model_ptr_->Lookup(query.args.first, keys.data(), keys.size(),
+                             results.data() + i)) {
+        i = end - 1;
+        continue;
+      }
+      results.resize(i);
+    }
+    // вложенные пакеты не поддерживаются, undo/redo внутри пакета тоже: пакет
+    // сам по себе одна отменяемая операция
+    if (query.type == QueryType::batch || query.type == QueryType::undo ||
+        query.type == QueryType::redo) {
+      results.push_back(MsgCode::empty_msg);
+      continue;
+    }
+    results.push_back(Execute(query));
+  }
+  model_ptr_->EndBatch(std::move(results));
+}
+
+MsgCode Controller::Execute(const UserQuery &data) {
+  auto profiler = model_ptr_->GetProfiler();
+  if (!profiler) {
+    return Dispatch(data);
+  }
+  auto start = profiler->Now();
+  auto rotations = model_ptr_->Rotations();
+  auto code = Dispatch(data);
+  profiler->Add(data.type, start, model_ptr_->Rotations() - rotations);
+  return code;
+}
+
+MsgCode Controller::Dispatch(const UserQuery &data) {
   switch (data.type) {
   case QueryType::insert:
-    Insert(data.args);
-    break;
+    return Insert(data.args);
   case QueryType::remove:
-    Remove(data.args);
-    break;
+    return Remove(data.args);
   case QueryType::find:
-    Find(data.args);
-    break;
+    return Find(data.args);
+  case QueryType::peek:
+    return Peek(data.args);
   case QueryType::split:
-    Split(data.args);
-    break;
+    return Split(data.args);
   case QueryType::merge:
-    Merge(data.args);
-    break;
+    return Merge(data.args);
   case QueryType::deltree:
-    DeleteTree(data.args);
-    break;
+    return DeleteTree(data.args);
+  case QueryType::freeze:
+    return Freeze(data.args);
+  case QueryType::policy:
+    return SetPolicy(data);
+  case QueryType::seq_make:
+  case QueryType::seq_insert:
+  case QueryType::seq_erase:
+  case QueryType::seq_split:
+  case QueryType::seq_reverse:
+  case QueryType::seq_add:
+    return Sequence(data);
+  case QueryType::range_extract:
+  case QueryType::range_erase:
+    return Range(data);
+  case QueryType::lower_bound:
+  case QueryType::upper_bound:
+  case QueryType::successor:
+  case QueryType::predecessor:
+    return Bound(data);
+  case QueryType::load:
+    return Load(data);
+  case QueryType::trace:
+    return model_ptr_->Record(data.args.first, data.args.second != 0);
+  case QueryType::optimal:
+    return model_ptr_->BuildOptimal(data.args.first);
+  case QueryType::heat:
+    return model_ptr_->SetHeatHalfLife(data.args.second);
+  case QueryType::heat_map:
+    return model_ptr_->HeatMap(data.args.second != 0);
+  case QueryType::link:
+  case QueryType::cut:
+  case QueryType::find_root:
+  case QueryType::connected:
+  case QueryType::path:
+    return Forest(data);
+  case QueryType::undo:
+    return Undo();
+  case QueryType::redo:
+    return Redo();
   default:
-    break;
+    return MsgCode::empty_msg;
+  }
+}
+
+void Controller::HandleMsg(const UserQuery &data) {
+  if (model_ptr_->Busy()) {
+    // запрос пришел, пока отрисовывался кадр другой операции (клик во время
+    // анимации): вложенная операция застала бы дерево посреди поворотов
+    DSVIZ_LOG(warn, "query {} arrived while another one is running, dropped",
+              data.type);
+    return;
+  }
+  if (data.type == QueryType::batch) {
+    Batch(data);
+    return;
   }
+  Execute(data);
 }
 
 } // namespace DSViz
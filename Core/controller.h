@@ -18,17 +18,47 @@ public:
   Observer<UserQuery> *GetPortIn();
 
 private:
-  void Insert(const ArgsType &args);
+  MsgCode Insert(const ArgsType &args);
 
-  void Remove(const ArgsType &args);
+  MsgCode Remove(const ArgsType &args);
 
-  void Find(const ArgsType &args);
+  MsgCode Find(const ArgsType &args);
 
-  void Split(const ArgsType &args);
+  MsgCode Peek(const ArgsType &args);
 
-  void Merge(const ArgsType &args);
+  MsgCode Split(const ArgsType &args);
 
-  void DeleteTree(const ArgsType &args);
+  MsgCode Merge(const ArgsType &args);
+
+  MsgCode DeleteTree(const ArgsType &args);
+
+  MsgCode Freeze(const ArgsType &args);
+
+  MsgCode SetPolicy(const UserQuery &data);
+
+  MsgCode Sequence(const UserQuery &data);
+
+  MsgCode Range(const UserQuery &data);
+
+  MsgCode Bound(const UserQuery &data);
+
+  MsgCode Load(const UserQuery &data);
+  // команды леса link-cut: args - пара вершин (для find_root только first)
+  MsgCode Forest(const UserQuery &data);
+
+  MsgCode Undo();
+
+  MsgCode Redo();
+
+  // весь пакет выполняется как одна команда: модель не отправляет
+  // промежуточные кадры, а в конце отправляет один кадр с результатами.
+  // Подряд идущие find по замороженному дереву ищутся в его копии пачкой
+  void Batch(const UserQuery &data);
+
+  // Dispatch, а если к модели подключен Profiler, еще и замер
+  MsgCode Execute(const UserQuery &data);
+
+  MsgCode Dispatch(const UserQuery &data);
 
   void HandleMsg(const UserQuery &data);
 
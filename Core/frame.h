@@ -0,0 +1,31 @@
+#ifndef FRAME_H
+#define FRAME_H
+#include "Common/node.h"
+#include "Common/policy.h"
+#include "Core/heat.h"
+#include "Core/overlay.h"
+#include "Core/trees.h"
+#include <vector>
+
+namespace DSViz {
+
+// то, что модель отправляет наблюдателям на каждом шаге
+struct Frame {
+  MsgCode code = MsgCode::empty_msg;
+  const detail::Trees *trees = nullptr;
+  // результаты запросов пакетной команды, заполнены только в кадре batch_done
+  std::vector<MsgCode> results = {};
+  // счетчики поисков дерева, заполнены только в итоговом кадре find
+  const SplayStats *splay = nullptr;
+  // ответ запроса к лесу link-cut (корень, агрегат по пути)
+  std::vector<int> values = {};
+  // состояния вершин для отрисовки кадра (Node их больше не хранит)
+  const detail::Overlay *overlay = nullptr;
+  // веса вершин для тепловой карты (пустые, пока она выключена)
+  const detail::HeatClock *heat = nullptr;
+  // итоговый кадр операции (в пакете - только batch_done)
+  bool last = false;
+};
+
+} // namespace DSViz
+#endif // FRAME_H
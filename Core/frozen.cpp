@@ -0,0 +1,121 @@
+#include "frozen.h"
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+
+#if defined(__GNUC__) || defined(__clang__)
+#define DSVIZ_PREFETCH(addr) __builtin_prefetch(addr)
+#else
+#define DSVIZ_PREFETCH(addr)
+#endif
+
+namespace DSViz {
+
+namespace detail {
+
+namespace {
+
+// раскладывает отсортированные ключи по Eytzinger. Рекурсия тут по высоте
+// полного дерева, т.е. O(log n), в отличие от обхода самого splay дерева
+size_t fill(const std::vector<int> &sorted, std::vector<int> *out, size_t i,
+            size_t k) {
+  if (k < out->size()) {
+    i = fill(sorted, out, i, 2 * k);
+    (*out)[k] = i < sorted.size() ? sorted[i] : INT_MAX;
+    ++i;
+    i = fill(sorted, out, i, 2 * k + 1);
+  }
+  return i;
+}
+
+} // namespace
+
+void FrozenTree::Build(PNode root) {
+  // splay дерево может быть бамбуком, так что обхожу его без рекурсии
+  std::vector<int> sorted;
+  std::vector<PNode> stack;
+  for (auto v = root; v || !stack.empty();) {
+    if (v) {
+      stack.push_back(v);
+      v = v->left;
+      continue;
+    }
+    v = stack.back();
+    stack.pop_back();
+    sorted.push_back(v->value);
+    v = v->right;
+  }
+
+  size_ = sorted.size();
+  levels_ = 0;
+  while ((size_t{1} << levels_) <= size_) {
+    ++levels_;
+  }
+  // лишние вершины полного дерева заполняются INT_MAX, так что совпадение с
+  // INT_MAX ничего не значит, и есть ли он в дереве, помню отдельно
+  has_max_ = !sorted.empty() && sorted.back() == INT_MAX;
+  keys_.assign(size_t{1} << levels_, INT_MAX);
+  fill(sorted, &keys_, 0, 1);
+  frozen_ = true;
+  stale_ = false;
+}
+
+void FrozenTree::Invalidate() { stale_ = frozen_; }
+
+void FrozenTree::Clear() {
+  keys_.clear();
+  keys_.shrink_to_fit();
+  size_ = 0;
+  levels_ = 0;
+  has_max_ = false;
+  frozen_ = stale_ = false;
+}
+
+bool FrozenTree::Frozen() const { return frozen_; }
+
+bool FrozenTree::Stale() const { return stale_; }
+
+size_t FrozenTree::Size() const { return size_; }
+
+void FrozenTree::Find(const int *keys, size_t count, bool *out) const {
+  for (size_t i = 0; i < count; i += kLanes) {
+    find_lanes(keys + i, std::min(kLanes, count - i), out + i);
+  }
+}
+
+void FrozenTree::find_lanes(const int *keys, size_t count, bool *out) const {
+  size_t pos[kLanes];
+  bool hit[kLanes];
+  for (size_t j = 0; j < kLanes; ++j) {
+    pos[j] = 1;
+    hit[j] = false;
+  }
+  // хвостовая группа добивается копиями последнего ключа, чтобы внутренние
+  // циклы всегда шли по всем kLanes и векторизовались компилятором
+  int x[kLanes];
+  for (size_t j = 0; j < kLanes; ++j) {
+    x[j] = keys[std::min(j, count - 1)];
+  }
+
+  const int *base = keys_.data();
+  for (int level = 0; level < levels_; ++level) {
+    for (size_t j = 0; j < kLanes; ++j) {
+      // потомки pos на 4 уровня ниже лежат подряд с индекса 16 * pos. Адрес
+      // может уйти за конец массива, но prefetch по нему ничего не читает
+      DSVIZ_PREFETCH(reinterpret_cast<const void *>(
+          reinterpret_cast<uintptr_t>(base) + 16 * pos[j] * sizeof(int)));
+    }
+    for (size_t j = 0; j < kLanes; ++j) {
+      int key = base[pos[j]];
+      hit[j] |= key == x[j];
+      pos[j] = 2 * pos[j] + (key < x[j]);
+    }
+  }
+  for (size_t j = 0; j < count; ++j) {
+    out[j] = x[j] == INT_MAX ? has_max_ : hit[j];
+  }
+}
+
+} // namespace detail
+
+} // namespace DSViz
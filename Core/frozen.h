@@ -0,0 +1,57 @@
+#ifndef FROZEN_H
+#define FROZEN_H
+#include "Common/node.h"
+#include <cstddef>
+#include <vector>
+
+namespace DSViz {
+
+namespace detail {
+
+// замороженная копия множества ключей дерева для чтения без splay. Ключи
+// лежат в массиве в порядке Eytzinger (обход в ширину, дети вершины k - это
+// 2k и 2k + 1), так что верхние уровни дерева поиска сидят в нескольких
+// кэш-линиях, а потомки на 4 уровня ниже - в одной-двух соседних.
+//
+// массив дополняется до полного дерева, поэтому спуск для любого ключа
+// занимает одинаковое число шагов и несколько запросов можно вести "в ногу"
+// без ветвлений. Копия не следит за деревом сама: модель помечает ее
+// устаревшей при изменении дерева и перестраивает при следующем поиске
+class FrozenTree {
+  using PNode = Node<int> *;
+
+public:
+  FrozenTree() = default;
+
+  void Build(PNode root);
+  // дерево поменялось, при следующем поиске копию надо перестроить
+  void Invalidate();
+  // дерево удалено или его id отдан другому дереву
+  void Clear();
+
+  bool Frozen() const;
+  bool Stale() const;
+  size_t Size() const;
+
+  // out[i] = есть ли keys[i] в дереве
+  void Find(const int *keys, size_t count, bool *out) const;
+
+  // сколько запросов спускаются одновременно
+  static constexpr const size_t kLanes = 16;
+
+private:
+  void find_lanes(const int *keys, size_t count, bool *out) const;
+
+  // keys_[0] не используется, keys_[1] - корень
+  std::vector<int> keys_;
+  size_t size_ = {};
+  int levels_ = {};
+  bool has_max_ = {};
+  bool frozen_ = {};
+  bool stale_ = {};
+};
+
+} // namespace detail
+
+} // namespace DSViz
+#endif // FROZEN_H
@@ -0,0 +1,119 @@
+#include "Core/heat.h"
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+namespace DSViz {
+
+namespace detail {
+
+void HeatClock::SetEnabled(bool on) {
+  enabled_ = on;
+  if (!on) {
+    weights_ = {};
+  }
+}
+
+bool HeatClock::Enabled() const { return enabled_; }
+
+void HeatClock::Touch(PNode v) {
+  if (!enabled_) {
+    return;
+  }
+  ++tick_;
+  double heat = Get(v) + 1;
+  weights_[v] = Weight{static_cast<float>(heat), tick_};
+}
+
+double HeatClock::Get(PNode v) const {
+  auto it = weights_.find(v);
+  if (it == weights_.end()) {
+    return 0;
+  }
+  auto [heat, tick] = it->second;
+  if (decay_ == 1) {
+    return heat;
+  }
+  // разность по модулю 2^32, так что переполнение tick_ не страшно
+  return heat * std::pow(decay_, static_cast<uint32_t>(tick_ - tick));
+}
+
+void HeatClock::Forget(PNode v) {
+  if (!weights_.empty()) {
+    weights_.erase(v);
+  }
+}
+
+void HeatClock::ForgetTree(PNode root) {
+  if (weights_.empty()) {
+    return;
+  }
+  std::vector<PNode> stack;
+  if (root) {
+    stack.push_back(root);
+  }
+  while (!stack.empty()) {
+    auto v = stack.back();
+    stack.pop_back();
+    weights_.erase(v);
+    if (v->left) {
+      stack.push_back(v->left);
+    }
+    if (v->right) {
+      stack.push_back(v->right);
+    }
+  }
+}
+
+void HeatClock::SetHalfLife(int accesses) {
+  half_life_ = std::max(accesses, 0);
+  decay_ = half_life_ > 0 ? std::exp2(-1.0 / half_life_) : 1;
+}
+
+int HeatClock::HalfLife() const { return half_life_; }
+
+// обход без рекурсии (дерево может быть бамбуком на миллионы вершин), лучшие
+// count держу в куче с самой холодной наверху
+std::vector<HeatClock::Hot> HeatClock::Top(PNode root, size_t count,
+                                           int *height) const {
+  auto colder = [](const Hot &a, const Hot &b) { return a.heat > b.heat; };
+  std::vector<Hot> top;
+  // обходить дерево ради высоты все равно надо, но без весов список пуст
+  if (weights_.empty()) {
+    count = 0;
+  }
+  std::vector<std::pair<PNode, int>> stack;
+  if (root) {
+    stack.push_back({root, 0});
+  }
+  int max_depth = -1;
+  while (!stack.empty()) {
+    auto [v, depth] = stack.back();
+    stack.pop_back();
+    max_depth = std::max(max_depth, depth);
+    double heat = Get(v);
+    if (heat > 0 && count > 0 && (top.size() < count || heat > top[0].heat)) {
+      if (top.size() == count) {
+        std::pop_heap(top.begin(), top.end(), colder);
+        top.pop_back();
+      }
+      top.push_back(Hot{v->value, heat, depth});
+      std::push_heap(top.begin(), top.end(), colder);
+    }
+    if (v->left) {
+      stack.push_back({v->left, depth + 1});
+    }
+    if (v->right) {
+      stack.push_back({v->right, depth + 1});
+    }
+  }
+  std::sort_heap(top.begin(), top.end(), colder);
+  if (height) {
+    *height = max_depth;
+  }
+  return top;
+}
+
+} // namespace detail
+
+} // namespace DSViz
@@ -0,0 +1,68 @@
+#ifndef HEAT_H
+#define HEAT_H
+#include "Common/node.h"
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+namespace DSViz {
+
+namespace detail {
+
+// счетчики обращений к вершинам и часы для них. Затухание экспоненциальное,
+// по числу обращений ко всем деревьям модели: за half_life обращений вес
+// вершины падает вдвое. Пересчитывать все вершины на каждое обращение
+// дорого, так что для вершины хранится вес на момент ее последнего обращения
+// и его номер, а текущий вес досчитывается при чтении.
+//
+// веса лежат в отдельной таблице, а не в Node: нужны они только тепловой
+// карте, и пока она выключена, таблицы нет вовсе, а Touch ничего не стоит
+class HeatClock {
+  using PNode = const Node<int> *;
+
+public:
+  struct Hot {
+    int key;
+    double heat;
+    // глубина в дереве, корень - 0
+    int depth;
+  };
+
+  // выключение забывает все веса
+  void SetEnabled(bool on);
+  bool Enabled() const;
+
+  void Touch(PNode v);
+  double Get(PNode v) const;
+  // вершина (или все дерево root) освобождается, ее адрес может достаться
+  // новой вершине
+  void Forget(PNode v);
+  void ForgetTree(PNode root);
+
+  // 0 - без затухания. Накопленные веса при смене не пересчитываются
+  void SetHalfLife(int accesses);
+  int HalfLife() const;
+
+  // count самых горячих вершин дерева root по убыванию веса (вершины, к
+  // которым не обращались, не попадают), в *height - высота дерева
+  std::vector<Hot> Top(PNode root, size_t count, int *height = nullptr) const;
+
+private:
+  struct Weight {
+    float heat;
+    uint32_t tick;
+  };
+
+  std::unordered_map<PNode, Weight> weights_;
+  bool enabled_ = {};
+  uint32_t tick_ = {};
+  int half_life_ = {};
+  // множитель веса за одно обращение
+  double decay_ = 1;
+};
+
+} // namespace detail
+
+} // namespace DSViz
+#endif // HEAT_H
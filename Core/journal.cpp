@@ -0,0 +1,279 @@
+#include "Core/journal.h"
+#include "Core/reclaimer.h"
+#include "Core/trees.h"
+#include <algorithm>
+#include <utility>
+
+namespace DSViz {
+
+namespace detail {
+
+Journal::Links Journal::Links::Of(PNode node) {
+  return Links{node->par,   node->left, node->right, node->value,
+               node->min,   node->max,  node->size,  node->rev,
+               node->add};
+}
+
+void Journal::Links::CopyTo(PNode node) const {
+  node->par = par;
+  node->left = left;
+  node->right = right;
+  node->value = value;
+  node->min = min;
+  node->max = max;
+  node->size = size;
+  node->rev = rev;
+  node->add = add;
+}
+
+bool Journal::Links::Same(PNode node) const {
+  return par == node->par && left == node->left && right == node->right &&
+         value == node->value && min == node->min && max == node->max &&
+         size == node->size && rev == node->rev && add == node->add;
+}
+
+bool Journal::Revision::Empty() const {
+  return nodes.empty() && slots.empty() && created.empty() &&
+         released.empty() && released_trees.empty();
+}
+
+Journal::Journal(Trees *trees, HeatClock *heat)
+    : trees_{trees}, heat_{heat} {}
+
+Journal::~Journal() {
+  // к этому моменту живые деревья принадлежат Trees, здесь освобождаю только
+  // то, что недостижимо из текущей версии
+  for (auto &rev : undo_) {
+    FreeReleased(&rev);
+  }
+  for (auto &rev : redo_) {
+    FreeCreated(&rev);
+  }
+  FreeReleased(&cur_);
+}
+
+void Journal::Begin(bool fold) {
+  if (depth_++ == 0) {
+    fold_ = fold;
+  }
+}
+
+void Journal::Commit() {
+  if (--depth_ > 0) {
+    return;
+  }
+  depth_ = 0;
+
+  if (limit_ == 0) {
+    // без истории журнал помнит только удаленное, hidden_root в их числе
+    FreeReleased(&cur_);
+    cur_ = {};
+    return;
+  }
+
+  // вспомогательные вершины (hidden_root) живут в пределах одной операции.
+  // Если ничего не освобождалось, искать их незачем, а созданных вершин
+  // бывают миллионы (Model::Load)
+  if (!cur_.released.empty()) {
+    std::unordered_set<PNode> created{cur_.created.begin(),
+                                      cur_.created.end()};
+    std::unordered_set<PNode> freed;
+    std::vector<PNode> released;
+    for (auto node : cur_.released) {
+      if (created.erase(node)) {
+        freed.insert(node);
+        delete node;
+      } else {
+        released.push_back(node);
+      }
+    }
+    if (!freed.empty()) {
+      std::vector<std::pair<PNode, Links>> nodes;
+      for (auto &entry : cur_.nodes) {
+        if (freed.find(entry.first) == freed.end()) {
+          nodes.push_back(entry);
+        }
+      }
+      cur_.nodes = std::move(nodes);
+    }
+    cur_.created.assign(created.begin(), created.end());
+    cur_.released = std::move(released);
+  }
+  cur_.touched.clear();
+  cur_.touched_slots.clear();
+  Shrink(&cur_);
+
+  if (cur_.Empty()) {
+    cur_ = {};
+    return;
+  }
+  // повороты ломают сохраненные в redo значения, как и любое изменение
+  for (auto &rev : redo_) {
+    FreeCreated(&rev);
+  }
+  redo_.clear();
+  if (fold_) {
+    // отменять нечего: раньше дерево было ровно таким же по ключам
+    if (undo_.empty()) {
+      FreeReleased(&cur_);
+      cur_ = {};
+      return;
+    }
+    auto &last = undo_.back();
+    last.nodes.insert(last.nodes.end(), cur_.nodes.begin(), cur_.nodes.end());
+    last.slots.insert(last.slots.end(), cur_.slots.begin(), cur_.slots.end());
+    last.created.insert(last.created.end(), cur_.created.begin(),
+                        cur_.created.end());
+    last.released.insert(last.released.end(), cur_.released.begin(),
+                         cur_.released.end());
+    last.released_trees.insert(last.released_trees.end(),
+                               cur_.released_trees.begin(),
+                               cur_.released_trees.end());
+    cur_ = {};
+    return;
+  }
+  undo_.push_back(std::move(cur_));
+  cur_ = {};
+  if (undo_.size() > limit_) {
+    FreeReleased(&undo_.front());
+    undo_.pop_front();
+  }
+}
+
+void Journal::Touch(PNode node) {
+  if (limit_ == 0 || !node || !cur_.touched.insert(node).second) {
+    return;
+  }
+  cur_.nodes.push_back({node, Links::Of(node)});
+}
+
+void Journal::TouchSlot(int id, PNode root, bool alive, Trees::Mode mode) {
+  if (limit_ == 0 || !cur_.touched_slots.insert(id).second) {
+    return;
+  }
+  cur_.slots.push_back({id, root, alive, mode});
+}
+
+void Journal::Created(PNode node) {
+  if (limit_ != 0) {
+    cur_.created.push_back(node);
+  }
+}
+
+void Journal::Release(PNode node) { cur_.released.push_back(node); }
+
+void Journal::ReleaseTree(PNode root) {
+  if (root) {
+    cur_.released_trees.push_back(root);
+  }
+}
+
+bool Journal::Undo() {
+  if (undo_.empty()) {
+    return false;
+  }
+  Swap(&undo_.back(), true);
+  redo_.push_back(std::move(undo_.back()));
+  undo_.pop_back();
+  return true;
+}
+
+bool Journal::Redo() {
+  if (redo_.empty()) {
+    return false;
+  }
+  Swap(&redo_.back(), false);
+  undo_.push_back(std::move(redo_.back()));
+  redo_.pop_back();
+  return true;
+}
+
+void Journal::SetLimit(size_t limit) {
+  limit_ = limit;
+  while (undo_.size() > limit_) {
+    FreeReleased(&undo_.front());
+    undo_.pop_front();
+  }
+  if (limit_ == 0) {
+    for (auto &rev : redo_) {
+      FreeCreated(&rev);
+    }
+    redo_.clear();
+  }
+}
+
+void Journal::Swap(Revision *rev, bool undo) {
+  auto swap_node = [](std::pair<PNode, Links> &entry) {
+    auto cur = Links::Of(entry.first);
+    entry.second.CopyTo(entry.first);
+    entry.second = cur;
+  };
+  auto swap_slot = [this](SlotState &slot) {
+    bool alive = trees_->Contains(slot.id);
+    SlotState cur{slot.id, alive ? (*trees_)[slot.id] : nullptr, alive,
+                  trees_->ModeOf(slot.id)};
+    trees_->Restore(slot.id, slot.root, slot.alive, slot.mode);
+    slot = cur;
+  };
+  if (undo) {
+    std::for_each(rev->nodes.rbegin(), rev->nodes.rend(), swap_node);
+    std::for_each(rev->slots.rbegin(), rev->slots.rend(), swap_slot);
+  } else {
+    std::for_each(rev->nodes.begin(), rev->nodes.end(), swap_node);
+    std::for_each(rev->slots.begin(), rev->slots.end(), swap_slot);
+  }
+}
+
+void Journal::Shrink(Revision *rev) {
+  std::vector<std::pair<PNode, Links>> nodes;
+  for (auto &[node, links] : rev->nodes) {
+    if (!links.Same(node)) {
+      nodes.push_back({node, links});
+    }
+  }
+  rev->nodes = std::move(nodes);
+
+  std::vector<SlotState> slots;
+  for (auto &slot : rev->slots) {
+    bool alive = trees_->Contains(slot.id);
+    if (slot.alive != alive ||
+        (alive && (slot.root != (*trees_)[slot.id] ||
+                   slot.mode != trees_->ModeOf(slot.id)))) {
+      slots.push_back(slot);
+    }
+  }
+  rev->slots = std::move(slots);
+}
+
+// освобождает Reclaimer в своем потоке, здесь только отдаю
+void Journal::FreeCreated(Revision *rev) {
+  if (heat_) {
+    for (auto node : rev->created) {
+      heat_->Forget(node);
+    }
+  }
+  Reclaimer::Instance().Retire(std::move(rev->created));
+  rev->created.clear();
+}
+
+void Journal::FreeReleased(Revision *rev) {
+  if (heat_) {
+    for (auto node : rev->released) {
+      heat_->Forget(node);
+    }
+    for (auto root : rev->released_trees) {
+      heat_->ForgetTree(root);
+    }
+  }
+  auto &reclaimer = Reclaimer::Instance();
+  reclaimer.Retire(std::move(rev->released));
+  for (auto root : rev->released_trees) {
+    reclaimer.RetireTree(root);
+  }
+  rev->released.clear();
+  rev->released_trees.clear();
+}
+
+} // namespace detail
+
+} // namespace DSViz
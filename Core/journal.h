@@ -0,0 +1,120 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+#include "Common/node.h"
+#include "Core/heat.h"
+#include "Core/trees.h"
+#include <deque>
+#include <unordered_set>
+#include <vector>
+
+namespace DSViz {
+
+namespace detail {
+
+// журнал изменений для undo/redo. Вместо копии всего дерева на каждую операцию
+// запоминаются только старые значения тех вершин и слотов реестра, которые
+// операция поменяла (а splay трогает O(log n) вершин амортизированно).
+//
+// undo и redo делаются одним и тем же обменом: сохраненные значения меняются
+// местами с текущими, так что после undo в ревизии лежат значения для redo
+//
+// удаленные операцией вершины не освобождаются, пока операцию можно отменить,
+// а созданные - пока ее можно повторить
+class Journal {
+  using PNode = Node<int> *;
+
+  // то, что хранится в вершине кроме визуального состояния
+  struct Links {
+    PNode par, left, right;
+    int value, min, max;
+    int size;
+    bool rev;
+    int add;
+
+    static Links Of(PNode node);
+    void CopyTo(PNode node) const;
+    bool Same(PNode node) const;
+  };
+
+  struct SlotState {
+    int id;
+    PNode root;
+    bool alive;
+    Trees::Mode mode;
+  };
+
+  struct Revision {
+    std::vector<std::pair<PNode, Links>> nodes;
+    std::vector<SlotState> slots;
+    std::vector<PNode> created;
+    // удаленные вершины и целиком удаленные деревья (DeleteTree)
+    std::vector<PNode> released;
+    std::vector<PNode> released_trees;
+    std::unordered_set<PNode> touched;
+    std::unordered_set<int> touched_slots;
+
+    bool Empty() const;
+  };
+
+public:
+  // веса обращений (heat) хранятся отдельно от вершин, и перед тем, как
+  // отдать вершины на освобождение, журнал их оттуда вычеркивает
+  explicit Journal(Trees *trees, HeatClock *heat = nullptr);
+  ~Journal();
+
+  Journal(const Journal &) = delete;
+  Journal &operator=(const Journal &) = delete;
+  Journal(Journal &&) = delete;
+  Journal &operator=(Journal &&) = delete;
+
+  // операции могут быть вложенными (пакет из нескольких запросов), ревизия
+  // фиксируется, когда закрывается самая внешняя.
+  //
+  // fold - операция только читает (find, поиск соседей), но splay ее все
+  // равно поворачивает дерево. Своей ревизии она не получает, повороты
+  // дописываются к предыдущей, так что undo после insert и find отменяет
+  // insert. Учитывается только у самой внешней операции
+  void Begin(bool fold = false);
+  void Commit();
+
+  // вызываются перед изменением вершины/слота
+  void Touch(PNode node);
+  void TouchSlot(int id, PNode root, bool alive, Trees::Mode mode);
+
+  void Created(PNode node);
+  void Release(PNode node);
+  void ReleaseTree(PNode root);
+
+  bool Undo();
+  bool Redo();
+
+  // сколько ревизий хранить, 0 - история выключена: вершины и слоты не
+  // запоминаются вовсе, а удаленные вершины освобождаются в конце операции
+  void SetLimit(size_t limit);
+
+  static constexpr const size_t kMaxRevisions = 1 << 10;
+
+private:
+  // после fold одна вершина может попасть в ревизию дважды. Undo идет с
+  // конца, redo с начала, тогда побеждает самая ранняя запись
+  void Swap(Revision *rev, bool undo);
+  // выкидывает из ревизии записи, значения в которых не поменялись (например
+  // find нашел ключ в корне), чтобы не было пустых шагов undo
+  void Shrink(Revision *rev);
+  void FreeCreated(Revision *rev);
+  void FreeReleased(Revision *rev);
+
+  std::deque<Revision> undo_;
+  std::vector<Revision> redo_;
+  Revision cur_;
+  Trees *trees_;
+  HeatClock *heat_;
+  size_t limit_ = kMaxRevisions;
+  int depth_ = {};
+  bool fold_ = {};
+};
+
+} // namespace detail
+
+} // namespace DSViz
+#endif // JOURNAL_H
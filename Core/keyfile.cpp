@@ -0,0 +1,197 @@
+#include "Core/keyfile.h"
+#include <QFile>
+#include <QtConcurrent>
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+
+namespace DSViz {
+
+namespace {
+
+bool IsSeparator(char c) {
+  return c == ' ' || c == '\n' || c == '\r' || c == '\t' || c == ',' ||
+         c == ';';
+}
+
+void SortUnique(std::vector<int> *keys) {
+  std::sort(keys->begin(), keys->end());
+  keys->erase(std::unique(keys->begin(), keys->end()), keys->end());
+}
+
+} // namespace
+
+bool KeyFile::Read(const QString &path, Format format, Result *result,
+                   const Progress &progress) {
+  bool binary = format == Format::binary ||
+                (format == Format::guess &&
+                 path.endsWith(".bin", Qt::CaseInsensitive));
+  QFile file{path};
+  if (!file.open(QIODevice::ReadOnly)) {
+    result->error = "cannot open " + path.toStdString();
+    return false;
+  }
+  auto size = file.size();
+  if (size == 0) {
+    return Parse(nullptr, 0, binary, result, progress);
+  }
+  // отображение живет, пока открыт file. Если отобразить не вышло (не обычный
+  // файл), читаю целиком
+  if (auto data = file.map(0, size)) {
+    return Parse(reinterpret_cast<const char *>(data),
+                 static_cast<size_t>(size), binary, result, progress);
+  }
+  QByteArray bytes = file.readAll();
+  return Parse(bytes.constData(), static_cast<size_t>(bytes.size()), binary,
+               result, progress);
+}
+
+bool KeyFile::Parse(const char *data, size_t size, bool binary,
+                    Result *result, const Progress &progress) {
+  static_assert(sizeof(int) == sizeof(int32_t), "keys are 32-bit");
+  result->keys.clear();
+  result->read = 0;
+  result->error.clear();
+  if (binary && size % sizeof(int32_t) != 0) {
+    result->error = "the file size is not a multiple of 4";
+    return false;
+  }
+
+  auto chunks = split(data, size, binary);
+  std::atomic<size_t> done = {};
+  QtConcurrent::blockingMap(chunks, [&](Chunk &chunk) {
+    if (binary) {
+      parse_binary(&chunk);
+    } else {
+      parse_text(data, &chunk);
+    }
+    if (progress) {
+      progress(static_cast<int>(kParseShare * ++done / chunks.size()));
+    }
+  });
+
+  size_t bad = kNoError;
+  std::vector<std::vector<int>> runs;
+  runs.reserve(chunks.size());
+  for (auto &chunk : chunks) {
+    bad = std::min(bad, chunk.bad);
+    result->read += chunk.read;
+    runs.push_back(std::move(chunk.keys));
+  }
+  if (bad != kNoError) {
+    result->error = "bad number at byte " + std::to_string(bad);
+    return false;
+  }
+  result->keys = merge(std::move(runs), progress);
+  if (progress) {
+    progress(100);
+  }
+  return true;
+}
+
+bool KeyFile::ParseFormat(const std::string &name, Format *format) {
+  if (name == "text") {
+    *format = Format::text;
+  } else if (name == "binary") {
+    *format = Format::binary;
+  } else if (name == "guess") {
+    *format = Format::guess;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+// границы кусков сдвигаются вправо до разделителя, чтобы число не попало в
+// два куска сразу. В двоичном файле kChunk и так кратен 4
+std::vector<KeyFile::Chunk> KeyFile::split(const char *data, size_t size,
+                                           bool binary) {
+  std::vector<Chunk> chunks;
+  size_t begin = 0;
+  while (begin < size) {
+    size_t end = std::min(size, begin + kChunk);
+    while (!binary && end < size && !IsSeparator(data[end - 1])) {
+      ++end;
+    }
+    chunks.push_back(Chunk{data + begin, data + end, {}, 0, kNoError});
+    begin = end;
+  }
+  return chunks;
+}
+
+void KeyFile::parse_text(const char *data, Chunk *chunk) {
+  // в среднем на число хотя бы несколько байт, так что перевыделений почти
+  // не будет
+  chunk->keys.reserve((chunk->end - chunk->begin) / 4);
+  for (auto cur = chunk->begin; cur != chunk->end;) {
+    if (IsSeparator(*cur)) {
+      ++cur;
+      continue;
+    }
+    int key;
+    auto [next, ec] = std::from_chars(cur, chunk->end, key);
+    if (ec != std::errc{} || (next != chunk->end && !IsSeparator(*next))) {
+      chunk->bad = static_cast<size_t>(cur - data);
+      break;
+    }
+    chunk->keys.push_back(key);
+    cur = next;
+  }
+  chunk->read = chunk->keys.size();
+  SortUnique(&chunk->keys);
+}
+
+void KeyFile::parse_binary(Chunk *chunk) {
+  chunk->keys.resize((chunk->end - chunk->begin) / sizeof(int32_t));
+  // копирую, а не читаю по указателю: так не надо думать о выравнивании
+  std::memcpy(chunk->keys.data(), chunk->begin,
+              chunk->keys.size() * sizeof(int32_t));
+  chunk->read = chunk->keys.size();
+  SortUnique(&chunk->keys);
+}
+
+// попарное слияние по раундам: в каждом раунде пары сливаются независимо, и
+// число кусков уменьшается вдвое. Последний раунд - одно слияние в одном
+// потоке, но это всего O(n)
+std::vector<int> KeyFile::merge(std::vector<std::vector<int>> runs,
+                                const Progress &progress) {
+  if (runs.empty()) {
+    return {};
+  }
+  int rounds = 0;
+  for (size_t n = runs.size(); n > 1; n = (n + 1) / 2) {
+    ++rounds;
+  }
+  for (int round = 0; runs.size() > 1; ++round) {
+    std::vector<std::vector<int>> merged((runs.size() + 1) / 2);
+    std::vector<size_t> pairs(merged.size());
+    for (size_t i = 0; i < pairs.size(); ++i) {
+      pairs[i] = i;
+    }
+    QtConcurrent::blockingMap(pairs, [&runs, &merged](size_t &i) {
+      auto &out = merged[i];
+      if (2 * i + 1 == runs.size()) {
+        out = std::move(runs[2 * i]);
+        return;
+      }
+      auto &lhs = runs[2 * i];
+      auto &rhs = runs[2 * i + 1];
+      // в каждом куске повторов уже нет, так что set_union дает множество
+      out.resize(lhs.size() + rhs.size());
+      out.erase(std::set_union(lhs.begin(), lhs.end(), rhs.begin(), rhs.end(),
+                               out.begin()),
+                out.end());
+      std::vector<int>{}.swap(lhs);
+      std::vector<int>{}.swap(rhs);
+    });
+    runs = std::move(merged);
+    if (progress) {
+      progress(kParseShare + (100 - kParseShare) * (round + 1) / rounds);
+    }
+  }
+  return std::move(runs.front());
+}
+
+} // namespace DSViz
@@ -0,0 +1,70 @@
+#ifndef KEYFILE_H
+#define KEYFILE_H
+#include <QString>
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace DSViz {
+
+// ключи из файла для Model::Load. Файл отображается в память и режется на
+// куски по kChunk байт, каждый кусок разбирается (std::from_chars) и
+// сортируется на пуле потоков. Потом отсортированные куски сливаются попарно,
+// тоже параллельно, с выбрасыванием повторов, так что на выходе ключи идут по
+// возрастанию без повторов - ровно то, что нужно Model::Load.
+//
+// текстовый файл - целые числа, разделенные пробелами, переводами строк,
+// запятыми или точками с запятой. Двоичный - подряд идущие int32 в порядке
+// байт машины
+class KeyFile {
+public:
+  enum class Format { guess, text, binary };
+
+  struct Result {
+    std::vector<int> keys;
+    // сколько чисел было в файле вместе с повторами
+    size_t read = 0;
+    std::string error;
+  };
+
+  // процент от 0 до 100. Зовется из потоков пула, так что GUI должен
+  // переправлять его в свой поток сам
+  using Progress = std::function<void(int percent)>;
+
+  // guess: файл .bin двоичный, остальные текстовые. При ошибке false, а
+  // причина в result->error
+  static bool Read(const QString &path, Format format, Result *result,
+                   const Progress &progress = {});
+  static bool Parse(const char *data, size_t size, bool binary,
+                    Result *result, const Progress &progress = {});
+
+  // text, binary или guess
+  static bool ParseFormat(const std::string &name, Format *format);
+
+  static constexpr const size_t kChunk = size_t{1} << 22;
+  // до этого процента идет разбор, дальше слияние
+  static constexpr const int kParseShare = 80;
+
+private:
+  struct Chunk {
+    const char *begin;
+    const char *end;
+    std::vector<int> keys;
+    // сколько чисел в куске вместе с повторами
+    size_t read;
+    // смещение первого некорректного числа от начала файла
+    size_t bad;
+  };
+
+  static constexpr const size_t kNoError = static_cast<size_t>(-1);
+
+  static std::vector<Chunk> split(const char *data, size_t size, bool binary);
+  static void parse_text(const char *data, Chunk *chunk);
+  static void parse_binary(Chunk *chunk);
+  static std::vector<int> merge(std::vector<std::vector<int>> runs,
+                                const Progress &progress);
+};
+
+} // namespace DSViz
+#endif // KEYFILE_H
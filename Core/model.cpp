@@ -1,184 +1,1134 @@
 #include "model.h"
+#include "Core/reclaimer.h"
+#include "Debug/log.h"
+#include "Debug/perf.h"
+#include <memory>
 
 namespace DSViz {
 
-namespace detail {
-
-Trees::~Trees() {
-  for (auto tree : trees_) {
-    destroy(tree.second);
-  }
+Model::Model() {
+  data_.Insert(nullptr);
+  // дерево 0 есть всегда, его создание не должно отменяться
+  data_.SetJournal(&journal_);
+  // пока еще никто на модель здесь не подписан, так что я просто изменю поле
+  // msg_ в Observable
+  notify(MsgCode::empty_msg);
 }
 
-void Trees::Insert(int id, PNode node) { trees_.insert({id, node}); }
-
-// здесь хренотень какая-то происходит, из-за чего падает merge
-void Trees::DeleteTree(int id) {
-  if (trees_.find(id) != trees_.end()) {
-    destroy(trees_[id]);
-    trees_.erase(id);
+Model::~Model() {
+  // вершинами леса владеет модель, а не реестр, так что перед разрушением
+  // реестра слоты леса надо отцепить
+  for (int id = 0; id < data_.Capacity(); ++id) {
+    if (data_.ModeOf(id) == Mode::forest) {
+      data_.Set(id, nullptr);
+    }
   }
+  Reclaimer::Instance().Retire(std::move(vertices_));
 }
 
-void Trees::DiscardTree(int id) {
-  if (trees_.find(id) != trees_.end()) {
-    trees_.erase(id);
+MsgCode Model::Insert(int id, int key) {
+  if (!check_id(id)) {
+    return MsgCode::wrong_id;
   }
-}
-
-size_t Trees::Size() const { return trees_.size(); }
-
-Trees::PNode &Trees::operator[](int key) { return trees_.at(key); }
-
-const Trees::BareTrees &Trees::Get() { return trees_; }
-
-void Trees::destroy(PNode node) {
-  if (!node) {
-    return;
+  if (!check_mode(id, Mode::values)) {
+    return MsgCode::mode_err;
   }
-  destroy(node->left);
-  destroy(node->right);
-  delete node;
-}
-
-} // namespace detail
-
-Model::Model() {
-  data_.Insert(next_id_++, nullptr);
-  // пока еще никто на модель здесь не подписан, так что я просто изменю поле
-  // msg_ в Observable
-  port_out_.Set(std::make_pair(MsgCode::empty_msg, data_.Get()));
-}
-
-void Model::Insert(int id, int key) {
+  Write write{this};
+  dirty(id);
   bool flag = false;
-  data_[id] = insert(data_[id], key, &flag);
-  port_out_.Set(std::make_pair(MsgCode::ins_done, data_.Get()));
+  data_.Set(id, insert(data_[id], key, &flag));
+  notify(MsgCode::ins_done);
   if (!flag) {
-    set_regular(data_[id]);
-    port_out_.Set(std::make_pair(MsgCode::insert_err, data_.Get()));
-    return;
+    overlay_.Clear();
+    return finish(MsgCode::insert_err);
   }
 
-  set_regular(data_[id]);
-  port_out_.Set(std::make_pair(MsgCode::OK, data_.Get()));
+  // новая вершина - корень
+  heat_.Touch(data_[id]);
+  thaw(id);
+  overlay_.Clear();
+  return finish(MsgCode::OK);
 }
 
-void Model::Remove(int id, int key) {
+MsgCode Model::Remove(int id, int key) {
+  if (!check_id(id)) {
+    return MsgCode::wrong_id;
+  }
+  if (!check_mode(id, Mode::values)) {
+    return MsgCode::mode_err;
+  }
+  Write write{this};
+  dirty(id);
   bool flag = false;
-  data_[id] = remove(data_[id], key, &flag);
+  data_.Set(id, remove(data_[id], key, &flag));
   if (!flag) {
-    set_regular(data_[id]);
-    port_out_.Set(std::make_pair(MsgCode::remove_err, data_.Get()));
-    return;
+    overlay_.Clear();
+    return finish(MsgCode::remove_err);
   }
+  thaw(id);
 
   if (data_[id]) {
-    data_[id]->state = State::new_root;
-    port_out_.Set(std::make_pair(MsgCode::new_root, data_.Get()));
-    data_[id]->state = State::regular;
+    mark(data_[id], State::new_root);
+    notify(MsgCode::new_root);
+    mark(data_[id], State::regular);
   }
 
-  port_out_.Set(std::make_pair(MsgCode::OK, data_.Get()));
+  return finish(MsgCode::OK);
 }
 
-void Model::Merge(int left_id, int right_id) {
+MsgCode Model::Merge(int left_id, int right_id) {
+  if (!check_id(left_id) || !check_id(right_id)) {
+    return MsgCode::wrong_id;
+  }
+  // две последовательности просто склеиваются, смешивать режимы нельзя, а
+  // слот леса не сливается ни с чем
+  auto mode = data_.ModeOf(left_id) == Mode::sequence ? Mode::sequence
+                                                       : Mode::values;
+  if (!check_mode(right_id, mode) || !check_mode(left_id, mode)) {
+    return MsgCode::mode_err;
+  }
+  Write write{this};
+  dirty(left_id);
+  dirty(right_id);
   if (left_id == right_id) {
-    port_out_.Set(std::make_pair(MsgCode::merge_equal, data_.Get()));
-    return;
+    return finish(MsgCode::merge_equal);
   }
   if (!data_[left_id] || !data_[right_id]) {
-    port_out_.Set(std::make_pair(MsgCode::merge_empty, data_.Get()));
-    return;
+    return finish(MsgCode::merge_empty);
   }
-  if (data_[left_id]->max < data_[right_id]->min) {
+  if (mode == Mode::sequence ||
+      data_[left_id]->max < data_[right_id]->min) {
     auto ltree = data_[left_id], rtree = data_[right_id];
     auto hidden_root = make_hidden_root(ltree, rtree);
+    journal_.Created(hidden_root);
     update(hidden_root);
+    journal_.Touch(rtree);
     rtree->par = hidden_root;
-    data_[left_id] = hidden_root;
-    data_[left_id] = merge(hidden_root);
+    data_.Set(left_id, hidden_root);
+    data_.Set(left_id, merge(hidden_root));
     // исправил багу, вообще неясно, почему оно еще раньше не упало (коммит
     // когда я заменил Erase и Destroy в классе Trees на одну функцию
     // DestroyTree) Тут именно важно что я удаляю ключ, а не все дерево, так что
     // завел функцию DiscardTree, которая именно это и делает
     data_.DiscardTree(right_id);
-    data_[left_id]->state = State::new_root;
-    port_out_.Set(std::make_pair(MsgCode::merge_end, data_.Get()));
-    data_[left_id]->state = State::regular;
-    port_out_.Set(std::make_pair(MsgCode::OK, data_.Get()));
-  } else {
-    port_out_.Set(std::make_pair(MsgCode::merge_err, data_.Get()));
+    thaw(left_id);
+    forget(right_id);
+    mark(data_[left_id], State::new_root);
+    notify(MsgCode::merge_end);
+    mark(data_[left_id], State::regular);
+    return finish(MsgCode::OK);
   }
+  return finish(MsgCode::merge_err);
 }
 
-void Model::Split(int id, int key) {
+MsgCode Model::Split(int id, int key) {
+  if (!check_id(id)) {
+    return MsgCode::wrong_id;
+  }
+  if (!check_mode(id, Mode::values)) {
+    return MsgCode::mode_err;
+  }
+  Write write{this};
+  dirty(id);
   if (!data_[id]) {
-    port_out_.Set(std::make_pair(MsgCode::split_err, data_.Get()));
-    return;
+    return finish(MsgCode::split_err);
   }
   auto [ltree, rtree] = split(data_[id], key);
-  if (data_[id]->state != State::hide_this) {
+  if (overlay_.Get(data_[id]) != State::hide_this) {
     if (ltree) {
-      ltree->state = State::regular;
+      mark(ltree, State::regular);
     }
     if (rtree) {
-      rtree->state = State::regular;
+      mark(rtree, State::regular);
     }
-    data_[id] = make_hidden_root(ltree, rtree);
+    data_.Set(id, make_hidden_root(ltree, rtree));
+    journal_.Created(data_[id]);
     update(data_[id]);
   }
-  port_out_.Set(std::make_pair(MsgCode::split_succ, data_.Get()));
-  delete data_[id];
-  data_[id] = ltree;
-  data_.Insert(next_id_++, rtree);
-  port_out_.Set(std::make_pair(MsgCode::OK, data_.Get()));
+  notify(MsgCode::split_succ);
+  journal_.Release(data_[id]);
+  data_.Set(id, ltree);
+  thaw(id);
+  int new_id = data_.Insert(rtree);
+  forget(new_id);
+  // access_of может переложить вектор, так что политику сначала копирую
+  auto policy = access_of(id).policy;
+  access_of(new_id).policy = policy;
+  return finish(MsgCode::OK);
+}
+
+MsgCode Model::ExtractRange(int id, int l, int r) {
+  return take_range(id, l, r, true);
+}
+
+MsgCode Model::EraseRange(int id, int l, int r) {
+  return take_range(id, l, r, false);
 }
 
-void Model::ExistKey(int id, int key) {
-  data_[id] = find(data_[id], key);
-  if (data_[id] && data_[id]->value == key) {
-    set_regular(data_[id]);
-    port_out_.Set(std::make_pair(MsgCode::found, data_.Get()));
+MsgCode Model::LowerBound(int id, int key) {
+  return bound(id, key, false, false);
+}
+
+MsgCode Model::UpperBound(int id, int key) {
+  return bound(id, key, false, true);
+}
+
+MsgCode Model::Successor(int id, int key) { return UpperBound(id, key); }
+
+MsgCode Model::Predecessor(int id, int key) {
+  return bound(id, key, true, true);
+}
+
+Model::Cursor Model::Scan(int id, int from, bool splay) {
+  return Cursor{this, id, from, splay};
+}
+
+Model::Cursor::Cursor(Model *model, int id, int from, bool splay)
+    : model_{model}, id_{id}, splay_{splay}, last_{from} {}
+
+size_t Model::Cursor::Next(int *out, size_t count) {
+  if (done_ || count == 0) {
+    return 0;
+  }
+  size_t res{};
+  if (splay_) {
+    {
+      Write write{model_, Log::fold};
+      Quiet quiet{model_, true};
+      model_->dirty(id_);
+      res = step(out, count);
+    }
+    // версию беру уже после Write: при выходе из него модель поднимает версии
+    // измененных деревьев, и свои же повороты не должны сбивать курсор
+    version_ = model_->data_.Version(id_);
   } else {
-    set_regular(data_[id]);
-    port_out_.Set(std::make_pair(MsgCode::not_found, data_.Get()));
+    // из кадра своей же операции блокировка уже моя
+    std::shared_lock lock{model_->mutex_, std::defer_lock};
+    if (!model_->Busy()) {
+      lock.lock();
+    }
+    res = step(out, count);
+    version_ = model_->data_.Version(id_);
   }
+  return res;
 }
 
-void Model::DeleteTree(int id) {
+bool Model::Cursor::Done() const { return done_; }
+
+size_t Model::Cursor::step(int *out, size_t count) {
+  auto &data = model_->data_;
+  if (!data.Contains(id_) || data.ModeOf(id_) != Mode::values) {
+    done_ = true;
+    return 0;
+  }
+  auto v = pos_ && data.Version(id_) == version_ ? pos_ : seek();
+  size_t n = 0;
+  while (v && n < count) {
+    out[n++] = v->value;
+    last_ = v->value;
+    started_ = true;
+    if (splay_) {
+      model_->splay(v);
+    }
+    // следующая по порядку: самая левая в правом поддереве, а если его нет -
+    // первый предок, для которого я в левом поддереве
+    if (v->right) {
+      v = v->right;
+      while (v->left) {
+        v = v->left;
+      }
+    } else {
+      while (v->par && v == v->par->right) {
+        v = v->par;
+      }
+      v = v->par;
+    }
+  }
+  pos_ = v;
+  done_ = !v;
+  return n;
+}
+
+Model::PNode Model::Cursor::seek() const {
+  // первый ключ > last_ (или >= начального, пока ничего не выдано)
+  PNode res = nullptr;
+  for (auto v = model_->data_[id_]; v;) {
+    if (v->value > last_ || (!started_ && v->value == last_)) {
+      res = v;
+      v = v->left;
+    } else {
+      v = v->right;
+    }
+  }
+  return res;
+}
+
+MsgCode Model::ExistKey(int id, int key, bool splay) {
+  if (!check_id(id)) {
+    return MsgCode::wrong_id;
+  }
+  if (!check_mode(id, Mode::values)) {
+    return MsgCode::mode_err;
+  }
+  Write write{this, Log::fold};
+  dirty(id);
+  // не при full политике найденная вершина может остаться не в корне, так
+  // что корень тут не переставляю: если splay дошел до верха, его уже
+  // обновил update_root
+  auto &access = access_of(id);
+  if (access.trace.Recording()) {
+    access.trace.Add(key);
+  }
+  // peek идет без политики и мимо ее счетчиков: они про то, сколько splay
+  // экономит политика, а peek не сплеит вовсе
+  Access peek{SplayPolicy{SplayPolicy::Kind::none}};
+  auto v = find(data_[id], key, splay ? &access : &peek);
+  overlay_.Clear();
+  if (v && v->value == key) {
+    heat_.Touch(v);
+    return finish(MsgCode::found, &access.stats);
+  }
+  return finish(MsgCode::not_found, &access.stats);
+}
+
+bool Model::Contains(int id, int key) const {
+  std::shared_lock lock{mutex_, std::defer_lock};
+  if (!Busy()) {
+    lock.lock();
+  }
+  if (!data_.Contains(id) || data_.ModeOf(id) != Mode::values) {
+    return false;
+  }
+  return descend(data_[id], key);
+}
+
+MsgCode Model::DeleteTree(int id) {
+  if (!check_id(id)) {
+    return MsgCode::wrong_id;
+  }
+  Write write{this};
   if (data_.Size() == 1) {
-    port_out_.Set(std::make_pair(MsgCode::unsucc_del, data_.Get()));
-    return;
+    return finish(MsgCode::unsucc_del);
+  }
+  if (data_.ModeOf(id) == Mode::forest) {
+    // сам лес не удаляется, пропадает только слот, через который он виден
+    data_.DiscardTree(id);
+  } else {
+    data_.DeleteTree(id);
+  }
+  forget(id);
+  return finish(MsgCode::succ_del);
+}
+
+MsgCode Model::Load(int id, const std::vector<int> &keys) {
+  if (id != -1) {
+    if (!check_id(id)) {
+      return MsgCode::wrong_id;
+    }
+    if (!check_mode(id, Mode::values)) {
+      return MsgCode::mode_err;
+    }
+  }
+  Write write{this};
+  overlay_.Clear();
+  DSVIZ_LOG(info, "load {} keys into tree {}", keys.size(), id);
+
+  // старые вершины по порядку, без рекурсии: после вставок по возрастанию
+  // дерево бывает бамбуком
+  std::vector<PNode> old;
+  std::vector<PNode> stack;
+  for (auto v = id == -1 ? nullptr : data_[id]; v || !stack.empty();) {
+    if (v) {
+      stack.push_back(v);
+      v = v->left;
+      continue;
+    }
+    v = stack.back();
+    stack.pop_back();
+    journal_.Touch(v);
+    old.push_back(v);
+    v = v->right;
   }
-  data_.DeleteTree(id);
-  port_out_.Set(std::make_pair(MsgCode::succ_del, data_.Get()));
+
+  // слияние двух упорядоченных последовательностей, на совпавших ключах
+  // остается старая вершина. Новые вершины в журнал попадают только как
+  // созданные: Touch на каждую из десятков миллионов был бы дороже самой
+  // загрузки
+  std::vector<PNode> nodes;
+  nodes.reserve(old.size() + keys.size());
+  size_t i = 0;
+  for (int key : keys) {
+    while (i < old.size() && old[i]->value < key) {
+      nodes.push_back(old[i++]);
+    }
+    if (i < old.size() && old[i]->value == key) {
+      continue;
+    }
+    nodes.push_back(new Node<int>{
+        .par = nullptr, .left = nullptr, .right = nullptr, .value = key});
+    journal_.Created(nodes.back());
+  }
+  nodes.insert(nodes.end(), old.begin() + i, old.end());
+  int added = static_cast<int>(nodes.size() - old.size());
+
+  auto root = build(nodes.data(), static_cast<int>(nodes.size()), nullptr);
+  if (id == -1) {
+    id = data_.Insert(root);
+    forget(id);
+  } else {
+    dirty(id);
+    data_.Set(id, root);
+    thaw(id);
+  }
+  return answer(MsgCode::load_done, {id, added});
+}
+
+Model::PNode Model::build(PNode *nodes, int count, PNode par) {
+  if (count == 0) {
+    return nullptr;
+  }
+  int mid = count / 2;
+  auto v = nodes[mid];
+  v->par = par;
+  v->left = build(nodes, mid, v);
+  v->right = build(nodes + mid + 1, count - mid - 1, v);
+  v->min = nodes[0]->value;
+  v->max = nodes[count - 1]->value;
+  v->size = count;
+  return v;
+}
+
+MsgCode Model::Freeze(int id) {
+  if (!check_id(id)) {
+    return MsgCode::wrong_id;
+  }
+  if (!check_mode(id, Mode::values)) {
+    return MsgCode::mode_err;
+  }
+  // деревья не меняются, но frozen_ читает Lookup из других потоков
+  Write write{this, Log::none};
+  if (frozen_.size() <= static_cast<size_t>(id)) {
+    frozen_.resize(id + 1);
+  }
+  frozen_[id].Build(data_[id]);
+  return finish(MsgCode::frozen);
+}
+
+bool Model::Lookup(int id, const int *keys, size_t count, MsgCode *out) {
+  if (Busy()) {
+    // внутри пакета блокировка и так монопольная
+    return lookup(id, keys, count, out);
+  }
+  {
+    // свежую копию запросы читают вместе. Счетчики тепловой карты и запись
+    // поисков так не обновить, с ними lookup идет монопольно
+    std::shared_lock lock{mutex_};
+    if (!frozen(id)) {
+      return false;
+    }
+    if (!frozen_[id].Stale() && !heat_.Enabled() && !recording(id)) {
+      return lookup(id, keys, count, out);
+    }
+  }
+  // перестраивает монопольно тот, кто первым увидел копию устаревшей.
+  // Пока блокировки не было, дерево могли удалить или разморозить, так что
+  // lookup проверяет все заново
+  Write write{this, Log::none};
+  return lookup(id, keys, count, out);
+}
+
+bool Model::frozen(int id) const {
+  return data_.Contains(id) && static_cast<size_t>(id) < frozen_.size() &&
+         frozen_[id].Frozen();
+}
+
+bool Model::lookup(int id, const int *keys, size_t count, MsgCode *out) {
+  if (!frozen(id)) {
+    return false;
+  }
+  if (frozen_[id].Stale()) {
+    frozen_[id].Build(data_[id]);
+  }
+  // в записи для сравнения с оптимальным деревом как раз нужны такие
+  // массовые чтения, пишу их, как ExistKey, вместе с промахами
+  if (recording(id)) {
+    auto &trace = access_[id].trace;
+    for (size_t i = 0; i < count; ++i) {
+      trace.Add(keys[i]);
+    }
+  }
+  auto hit = std::make_unique<bool[]>(count);
+  frozen_[id].Find(keys, count, hit.get());
+  for (size_t i = 0; i < count; ++i) {
+    out[i] = hit[i] ? MsgCode::found : MsgCode::not_found;
+  }
+  // поиск по копии - такое же обращение, как find. Вес достается вершине
+  // живого дерева, до нее спуск без splay: это дороже самой копии, но только
+  // пока включена тепловая карта
+  if (heat_.Enabled()) {
+    for (size_t i = 0; i < count; ++i) {
+      if (hit[i]) {
+        heat_.Touch(descend(data_[id], keys[i]));
+      }
+    }
+  }
+  return true;
+}
+
+bool Model::recording(int id) const {
+  return static_cast<size_t>(id) < access_.size() &&
+         access_[id].trace.Recording();
+}
+
+Model::PNode Model::descend(PNode v, int key) {
+  while (v && v->value != key) {
+    v = key < v->value ? v->left : v->right;
+  }
+  return v;
 }
 
 void Model::SubscribeToBareTree(Observer<Model::MsgType> *view_observer) {
   port_out_.Subscribe(view_observer);
 }
 
+bool Model::Busy() const { return owner_ == std::this_thread::get_id(); }
+
+void Model::EnableHeat(bool on) {
+  Write write{this, Log::none};
+  heat_.SetEnabled(on);
+}
+
+MsgCode Model::HeatMap(bool on) {
+  EnableHeat(on);
+  return finish(on ? MsgCode::heat_on : MsgCode::heat_off);
+}
+
+MsgCode Model::SetHeatHalfLife(int accesses) {
+  Write write{this, Log::none};
+  heat_.SetHalfLife(accesses);
+  return finish(MsgCode::heat_set);
+}
+
+void Model::SetProfiler(Profiler *profiler) { profiler_ = profiler; }
+
+Profiler *Model::GetProfiler() const { return profiler_; }
+
+long long Model::Rotations() const { return rotations_; }
+
+void Model::thaw(int id) {
+  if (static_cast<size_t>(id) < frozen_.size()) {
+    frozen_[id].Invalidate();
+  }
+}
+
+void Model::dirty(int id) {
+  if (std::find(dirty_.begin(), dirty_.end(), id) == dirty_.end()) {
+    dirty_.push_back(id);
+  }
+}
+
+void Model::forget(int id) {
+  if (static_cast<size_t>(id) < frozen_.size()) {
+    frozen_[id].Clear();
+  }
+  if (static_cast<size_t>(id) < access_.size()) {
+    access_[id] = Access{};
+  }
+}
+
+MsgCode Model::MakeSequence(int id) {
+  if (!check_id(id)) {
+    return MsgCode::wrong_id;
+  }
+  if (!check_mode(id, Mode::values)) {
+    return MsgCode::mode_err;
+  }
+  Write write{this};
+  // порядок обхода уже и есть последовательность, так что менять в дереве
+  // ничего не надо. Замороженная копия для последовательности смысла не имеет
+  data_.SetMode(id, Mode::sequence);
+  forget(id);
+  return finish(MsgCode::seq_mode);
+}
+
+MsgCode Model::InsertAt(int id, int index, int value) {
+  if (!check_id(id)) {
+    return MsgCode::wrong_id;
+  }
+  if (!check_mode(id, Mode::sequence)) {
+    return MsgCode::mode_err;
+  }
+  Write write{this};
+  dirty(id);
+  auto root = data_[id];
+  int n = size_of(root);
+  if (index < 0 || index > n) {
+    return finish(MsgCode::index_err);
+  }
+  PNode new_node{new Node<int>{.par = nullptr,
+                               .left = nullptr,
+                               .right = nullptr,
+                               .value = value,
+                               .min = value,
+                               .max = value}};
+  journal_.Created(new_node);
+  // как и в insert, новая вершина становится корнем: слева от нее все, что
+  // было до позиции index, справа - все остальное
+  if (index == n && root) {
+    auto last = at(root, n - 1);
+    splay(last);
+    journal_.Touch(last);
+    new_node->left = last;
+    last->par = new_node;
+  } else if (root) {
+    auto next = at(root, index);
+    splay(next);
+    journal_.Touch(next);
+    journal_.Touch(next->left);
+    new_node->left = next->left;
+    if (next->left) {
+      next->left->par = new_node;
+    }
+    next->left = nullptr;
+    update(next);
+    new_node->right = next;
+    next->par = new_node;
+  }
+  update(new_node);
+  data_.Set(id, new_node);
+  overlay_.Clear();
+  mark(new_node, State::inserted);
+  notify(MsgCode::ins_done);
+  mark(new_node, State::regular);
+  return finish(MsgCode::OK);
+}
+
+MsgCode Model::EraseAt(int id, int index) {
+  if (!check_id(id)) {
+    return MsgCode::wrong_id;
+  }
+  if (!check_mode(id, Mode::sequence)) {
+    return MsgCode::mode_err;
+  }
+  Write write{this};
+  dirty(id);
+  if (index < 0 || index >= size_of(data_[id])) {
+    return finish(MsgCode::index_err);
+  }
+  auto v = at(data_[id], index);
+  splay(v);
+  overlay_.Clear();
+  mark(v, State::do_remove);
+  notify(MsgCode::do_rem);
+  mark(v, State::hide_this);
+  data_.Set(id, merge(v));
+  if (data_[id]) {
+    mark(data_[id], State::new_root);
+    notify(MsgCode::new_root);
+    mark(data_[id], State::regular);
+  }
+  return finish(MsgCode::OK);
+}
+
+MsgCode Model::SplitAt(int id, int index) {
+  if (!check_id(id)) {
+    return MsgCode::wrong_id;
+  }
+  if (!check_mode(id, Mode::sequence)) {
+    return MsgCode::mode_err;
+  }
+  Write write{this};
+  dirty(id);
+  auto root = data_[id];
+  int n = size_of(root);
+  if (index < 0 || index > n) {
+    return finish(MsgCode::index_err);
+  }
+  PNode ltree = root, rtree = nullptr;
+  if (index < n) {
+    rtree = at(root, index);
+    splay(rtree);
+    overlay_.Clear();
+    ltree = rtree->left;
+    journal_.Touch(rtree);
+    journal_.Touch(ltree);
+    rtree->left = nullptr;
+    if (ltree) {
+      ltree->par = nullptr;
+    }
+    update(rtree);
+  }
+  // как и в Split, на время кадра оба дерева висят под скрытым корнем
+  data_.Set(id, make_hidden_root(ltree, rtree));
+  journal_.Created(data_[id]);
+  update(data_[id]);
+  notify(MsgCode::split_succ);
+  journal_.Release(data_[id]);
+  data_.Set(id, ltree);
+  int new_id = data_.Insert(rtree);
+  forget(new_id);
+  data_.SetMode(new_id, Mode::sequence);
+  return finish(MsgCode::OK);
+}
+
+MsgCode Model::Reverse(int id, int l, int r) {
+  return range(id, l, r, true, 0);
+}
+
+MsgCode Model::AddRange(int id, int l, int r, int delta) {
+  return range(id, l, r, false, delta);
+}
+
+MsgCode Model::Link(int u, int v, bool animate) {
+  Write write{this};
+  Quiet quiet{this, !animate};
+  auto a = vertex(u), b = vertex(v);
+  if (!a || !b) {
+    return finish(MsgCode::vertex_err);
+  }
+  if (a == b) {
+    return finish(MsgCode::link_err);
+  }
+  // a становится корнем своего дерева и подвешивается к b через родителя
+  // пути, так что ни одно splay дерево при этом не меняется
+  make_root(a);
+  if (find_root(b) == a) {
+    return finish(MsgCode::link_err);
+  }
+  journal_.Touch(a);
+  a->par = b;
+  show_forest(b);
+  return finish(MsgCode::OK);
+}
+
+MsgCode Model::Cut(int u, int v, bool animate) {
+  Write write{this};
+  Quiet quiet{this, !animate};
+  auto a = vertex(u), b = vertex(v);
+  if (!a || !b) {
+    return finish(MsgCode::vertex_err);
+  }
+  if (a == b) {
+    return finish(MsgCode::cut_err);
+  }
+  // после make_root(a) и access(b) путь a-b - это splay дерево b, а b в нем
+  // самая глубокая. Ребро есть, только если на пути ровно две вершины
+  make_root(a);
+  access(b);
+  if (b->left != a || b->size != 2) {
+    return finish(MsgCode::cut_err);
+  }
+  journal_.Touch(a);
+  journal_.Touch(b);
+  b->left = nullptr;
+  a->par = nullptr;
+  update(b);
+  return finish(MsgCode::OK);
+}
+
+MsgCode Model::FindRoot(int v, bool animate) {
+  Write write{this, Log::fold};
+  Quiet quiet{this, !animate};
+  auto a = vertex(v);
+  if (!a) {
+    return finish(MsgCode::vertex_err);
+  }
+  return answer(MsgCode::forest_root, {find_root(a)->value});
+}
+
+MsgCode Model::Connected(int u, int v, bool animate) {
+  Write write{this, Log::fold};
+  Quiet quiet{this, !animate};
+  auto a = vertex(u), b = vertex(v);
+  if (!a || !b) {
+    return finish(MsgCode::vertex_err);
+  }
+  if (find_root(a) == find_root(b)) {
+    return finish(MsgCode::connected);
+  }
+  return finish(MsgCode::disconnected);
+}
+
+MsgCode Model::PathAggregate(int u, int v, bool animate) {
+  Write write{this, Log::fold};
+  Quiet quiet{this, !animate};
+  auto a = vertex(u), b = vertex(v);
+  if (!a || !b) {
+    return finish(MsgCode::vertex_err);
+  }
+  make_root(a);
+  if (find_root(b) != a) {
+    return finish(MsgCode::disconnected);
+  }
+  // агрегаты splay дерева b после access - это агрегаты по пути a-b
+  access(b);
+  return answer(MsgCode::path_done, {b->size, b->min, b->max});
+}
+
+int Model::ForestId() const {
+  return data_.ModeOf(forest_id_) == Mode::forest ? forest_id_ : -1;
+}
+
+MsgCode Model::SetPolicy(int id, const SplayPolicy &policy) {
+  if (!check_id(id)) {
+    return MsgCode::wrong_id;
+  }
+  // запись поисков при смене политики не сбрасываю
+  auto &access = access_of(id);
+  access.policy = policy;
+  access.stats = {};
+  return finish(MsgCode::policy_set);
+}
+
+MsgCode Model::Record(int id, bool on) {
+  if (!check_id(id)) {
+    return MsgCode::wrong_id;
+  }
+  if (!check_mode(id, Mode::values)) {
+    return MsgCode::mode_err;
+  }
+  // деревья не меняются, но форму дерева читаю под той же блокировкой
+  Write write{this, Log::none};
+  auto &trace = access_of(id).trace;
+  if (on) {
+    trace.Start(data_[id]);
+    return finish(MsgCode::trace_on);
+  }
+  trace.Stop();
+  return answer(MsgCode::trace_off,
+                {static_cast<int>(trace.Keys().size())});
+}
+
+MsgCode Model::BuildOptimal(int id) {
+  if (!check_id(id)) {
+    return MsgCode::wrong_id;
+  }
+  if (!check_mode(id, Mode::values)) {
+    return MsgCode::mode_err;
+  }
+  Write write{this};
+  // ниже access_of(new_id) может переложить access_, так что все, что нужно
+  // из записи, считаю до того
+  const auto &trace = access_of(id).trace;
+  if (trace.Keys().empty()) {
+    return finish(MsgCode::trace_empty);
+  }
+
+  std::vector<int> keys;
+  std::vector<PNode> stack;
+  for (auto v = data_[id]; v || !stack.empty();) {
+    if (v) {
+      stack.push_back(v);
+      v = v->left;
+      continue;
+    }
+    v = stack.back();
+    stack.pop_back();
+    keys.push_back(v->value);
+    v = v->right;
+  }
+  std::vector<long long> hits(keys.size()), misses(keys.size() + 1);
+  for (int key : trace.Keys()) {
+    auto it = std::lower_bound(keys.begin(), keys.end(), key);
+    size_t k = it - keys.begin();
+    if (it != keys.end() && *it == key) {
+      ++hits[k];
+    } else {
+      ++misses[k];
+    }
+  }
+  bool exact = keys.size() <= detail::OptimalBst::kKnuthMax;
+  auto shape = exact ? detail::OptimalBst::Knuth(keys, hits, misses)
+                     : detail::OptimalBst::Mehlhorn(keys, hits, misses);
+  long long count = static_cast<long long>(trace.Keys().size());
+  long long splay_cost =
+      detail::TraceReplay{trace.Shape()}.Splay(trace.Keys());
+  long long static_cost = detail::TraceReplay{shape}.Static(trace.Keys());
+  DSVIZ_LOG(info, "optimal bst for tree {}: {} finds, splay {}, static {}",
+            id, count, splay_cost, static_cost);
+
+  // дерево из прямого порядка: стек - это путь от корня до последней вершины,
+  // у которой еще может появиться правый сын. В обратном прямом порядке
+  // потомки идут раньше предков, так что size, min и max считаются одним
+  // проходом с конца
+  std::vector<PNode> nodes;
+  nodes.reserve(shape.size());
+  stack.clear();
+  for (int key : shape) {
+    auto v = new Node<int>{
+        .par = nullptr, .left = nullptr, .right = nullptr, .value = key};
+    journal_.Created(v);
+    if (!stack.empty() && key < stack.back()->value) {
+      stack.back()->left = v;
+      v->par = stack.back();
+    } else if (!stack.empty()) {
+      while (!stack.empty() && stack.back()->value < key) {
+        v->par = stack.back();
+        stack.pop_back();
+      }
+      v->par->right = v;
+    }
+    stack.push_back(v);
+    nodes.push_back(v);
+  }
+  for (auto it = nodes.rbegin(); it != nodes.rend(); ++it) {
+    auto v = *it;
+    v->min = v->left ? v->left->min : v->value;
+    v->max = v->right ? v->right->max : v->value;
+    v->size = 1 + size_of(v->left) + size_of(v->right);
+  }
+
+  int new_id = data_.Insert(nodes.empty() ? nullptr : nodes.front());
+  forget(new_id);
+  // статическому дереву splay не нужен
+  access_of(new_id).policy = SplayPolicy{SplayPolicy::Kind::none};
+  auto per_find = [count](long long cost) {
+    return static_cast<int>(cost * 100 / count);
+  };
+  return answer(MsgCode::optimal_done,
+                {new_id, exact, static_cast<int>(count), per_find(splay_cost),
+                 per_find(static_cost)});
+}
+
+SplayStats Model::Stats(int id) const {
+  if (static_cast<size_t>(id) < access_.size()) {
+    return access_[id].stats;
+  }
+  return {};
+}
+
+Model::Access &Model::access_of(int id) {
+  if (access_.size() <= static_cast<size_t>(id)) {
+    access_.resize(id + 1);
+  }
+  return access_[id];
+}
+
+bool Model::check_mode(int id, Mode mode) {
+  if (data_.ModeOf(id) != mode) {
+    notify(MsgCode::mode_err);
+    return false;
+  }
+  return true;
+}
+
+bool Model::check_id(int id) {
+  if (!data_.Contains(id)) {
+    notify(MsgCode::wrong_id);
+    return false;
+  }
+  return true;
+}
+
+MsgCode Model::Undo() {
+  Write write{this, Log::none};
+  if (!journal_.Undo()) {
+    return finish(MsgCode::undo_empty);
+  }
+  overlay_.Reset();
+  // отмена может поменять любое дерево
+  for (auto &tree : frozen_) {
+    tree.Invalidate();
+  }
+  for (int id = 0; id < data_.Capacity(); ++id) {
+    data_.Bump(id);
+  }
+  return finish(MsgCode::undo_done);
+}
+
+MsgCode Model::Redo() {
+  Write write{this, Log::none};
+  if (!journal_.Redo()) {
+    return finish(MsgCode::redo_empty);
+  }
+  overlay_.Reset();
+  for (auto &tree : frozen_) {
+    tree.Invalidate();
+  }
+  for (int id = 0; id < data_.Capacity(); ++id) {
+    data_.Bump(id);
+  }
+  return finish(MsgCode::redo_done);
+}
+
+void Model::SetUndoLimit(size_t revisions) {
+  Write write{this, Log::none};
+  journal_.SetLimit(revisions);
+}
+
+void Model::BeginBatch(int sample) {
+  // весь пакет - одна ревизия, отменяется целиком
+  lock_write();
+  journal_.Begin();
+  batch_ = true;
+  batch_sample_ = sample;
+  batch_frames_ = 0;
+  DSVIZ_LOG(info, "batch begin, sample {}", sample);
+}
+
+void Model::EndBatch(std::vector<MsgCode> results) {
+  journal_.Commit();
+  unlock_write();
+  batch_ = false;
+  DSVIZ_LOG(info, "batch end, {} queries, {} frames", results.size(),
+            batch_frames_);
+  // мимо send: итог пакета не прореживается sample и не глушится
+  port_out_.Set(Frame{MsgCode::batch_done, &data_, std::move(results),
+                      nullptr, {}, &overlay_, &heat_, true});
+}
+
+Model::Write::Write(Model *model, Log log) : model_{model}, log_{log} {
+  model_->lock_write();
+  if (log_ != Log::none) {
+    model_->journal_.Begin(log_ == Log::fold);
+  }
+}
+
+Model::Write::~Write() {
+  // ревизию закрываю до того, как пустить читателей: Commit удаляет вершины
+  if (log_ != Log::none) {
+    model_->journal_.Commit();
+  }
+  model_->unlock_write();
+}
+
+Model::Quiet::Quiet(Model *model, bool on)
+    : model_{model}, old_{model->quiet_} {
+  model_->quiet_ = old_ || on;
+}
+
+Model::Quiet::~Quiet() { model_->quiet_ = old_; }
+
+void Model::lock_write() {
+  if (Busy()) {
+    ++writers_;
+    return;
+  }
+  mutex_.lock();
+  owner_ = std::this_thread::get_id();
+  writers_ = 1;
+}
+
+void Model::unlock_write() {
+  --writers_;
+  // закончилась операция (в пакете - очередной его запрос): удаленные
+  // вершины и hidden_root к этому моменту уже отпущены. Без этого в пакете
+  // пометки hide_this копились бы до EndBatch
+  if (writers_ == 0 || (batch_ && writers_ == 1)) {
+    overlay_.Reset();
+  }
+  if (writers_ == 0) {
+    for (int id : dirty_) {
+      data_.Bump(id);
+    }
+    dirty_.clear();
+    owner_ = std::thread::id{};
+    mutex_.unlock();
+  }
+}
+
+void Model::send(Frame frame, bool last) {
+  // между кадрами дерево могли повернуть, не трогая слот
+  for (int id : dirty_) {
+    data_.Bump(id);
+  }
+  if ((quiet_ && !last) ||
+      (batch_ &&
+       (batch_sample_ <= 0 || ++batch_frames_ % batch_sample_ != 0))) {
+    return;
+  }
+  frame.overlay = &overlay_;
+  frame.heat = &heat_;
+  frame.last = last && !batch_;
+  // кадр рисуют и копируют подписчики, это не цена операции
+  if (profiler_) {
+    profiler_->Pause();
+  }
+  port_out_.Set(std::move(frame));
+  if (profiler_) {
+    profiler_->Resume();
+  }
+}
+
+void Model::notify(MsgCode code, const SplayStats *splay) {
+  send(Frame{code, &data_, {}, splay});
+}
+
+MsgCode Model::finish(MsgCode code, const SplayStats *splay) {
+  DSVIZ_LOG(debug, "done: code {}, rotations {}", code, rotations_);
+  send(Frame{code, &data_, {}, splay}, true);
+  return code;
+}
+
+MsgCode Model::answer(MsgCode code, std::vector<int> values) {
+  send(Frame{code, &data_, {}, nullptr, std::move(values)}, true);
+  return code;
+}
+
 void Model::update(PNode v) {
   if (!v) {
     return;
   }
+  journal_.Touch(v);
+  // в последовательности значения не упорядочены, так что min и max беру по
+  // обоим детям. Для обычного дерева результат тот же
   v->min = v->max = v->value;
-  if (v->left) {
-    v->min = std::min(v->min, v->left->min);
+  v->size = 1;
+  for (auto child : {v->left, v->right}) {
+    if (child) {
+      v->min = std::min(v->min, child->min);
+      v->max = std::max(v->max, child->max);
+      v->size += child->size;
+    }
   }
-  if (v->right) {
-    v->max = std::max(v->max, v->right->max);
+}
+
+void Model::push(PNode v) {
+  if (!v || (!v->rev && !v->add)) {
+    return;
   }
+  auto state = overlay_.Get(v);
+  mark(v, State::push_tag);
+  notify(MsgCode::push_perf);
+  journal_.Touch(v);
+  apply(v->left, v->rev, v->add);
+  apply(v->right, v->rev, v->add);
+  v->rev = false;
+  v->add = 0;
+  mark(v, state);
 }
 
+void Model::apply(PNode v, bool rev, int add) {
+  if (!v) {
+    return;
+  }
+  journal_.Touch(v);
+  if (rev) {
+    std::swap(v->left, v->right);
+    v->rev = !v->rev;
+  }
+  v->value += add;
+  v->min += add;
+  v->max += add;
+  v->add += add;
+}
+
+int Model::size_of(PNode v) { return v ? v->size : 0; }
+
 void Model::rotate_left(PNode v) {
+  ++rotations_;
+  DSVIZ_LOG(trace, "rotate left at {}", v->value);
   auto p = v->par;
   auto r = v->right;
+  journal_.Touch(p);
+  journal_.Touch(v);
+  journal_.Touch(r);
+  journal_.Touch(r->left);
   if (p) {
+    // в лесе link-cut p может быть родителем пути, а не настоящим отцом
     if (p->left == v) {
       p->left = r;
-    } else {
+    } else if (p->right == v) {
       p->right = r;
     }
   }
@@ -196,13 +1146,19 @@ void Model::rotate_left(PNode v) {
 }
 
 void Model::rotate_right(PNode v) {
+  ++rotations_;
+  DSVIZ_LOG(trace, "rotate right at {}", v->value);
   auto p = v->par;
   auto r = v->left;
+  journal_.Touch(p);
+  journal_.Touch(v);
+  journal_.Touch(r);
+  journal_.Touch(r->right);
 
   if (p) {
     if (p->left == v) {
       p->left = r;
-    } else {
+    } else if (p->right == v) {
       p->right = r;
     }
   }
@@ -219,28 +1175,40 @@ void Model::rotate_right(PNode v) {
   update(p);
 }
 
-void Model::splay(PNode v, PNode hidden_root) {
-  set_regular(v);
-  v->state = State::splay_ver;
-  port_out_.Set(std::make_pair(MsgCode::splay_perf, data_.Get()));
+void Model::splay(PNode v, PNode hidden_root, bool semi) {
+  Profiler::Sample start;
+  auto before = rotations_;
+  bool profile = profiler_ && profiler_->Splays();
+  if (profile) {
+    start = profiler_->Now();
+  }
+  overlay_.Clear();
+  mark(v, State::splay_ver);
+  notify(MsgCode::splay_perf);
 
-  while (v->par) {
+  while (!top(v)) {
     if (v == v->par->left) {
-      if (!v->par->par) {
+      if (top(v->par)) {
         zig(v, hidden_root, true);
 
       } else if (v->par == v->par->par->left) {
-        zig_zig(v, hidden_root, true);
+        zig_zig(v, hidden_root, true, semi);
+        if (semi) {
+          v = v->par;
+        }
 
       } else {
         zig_zag(v, hidden_root, true);
       }
     } else {
-      if (!v->par->par) {
+      if (top(v->par)) {
         zig(v, hidden_root, false);
 
       } else if (v->par == v->par->par->right) {
-        zig_zig(v, hidden_root, false);
+        zig_zig(v, hidden_root, false, semi);
+        if (semi) {
+          v = v->par;
+        }
 
       } else {
         zig_zag(v, hidden_root, false);
@@ -248,9 +1216,12 @@ void Model::splay(PNode v, PNode hidden_root) {
     }
   }
 
-  set_regular(v);
-  v->state = State::splay_ver;
-  port_out_.Set(std::make_pair(MsgCode::splay_perf, data_.Get()));
+  overlay_.Clear();
+  mark(v, State::splay_ver);
+  notify(MsgCode::splay_perf);
+  if (profile) {
+    profiler_->AddSplay(start, rotations_ - before);
+  }
 }
 
 void Model::zig(PNode v, PNode hidden_root, bool is_right_zig) {
@@ -259,7 +1230,7 @@ void Model::zig(PNode v, PNode hidden_root, bool is_right_zig) {
   } else {
     set_state(v, v->par->left, v->left, v->right);
   }
-  port_out_.Set(std::make_pair(MsgCode::zig_perf, data_.Get()));
+  notify(MsgCode::zig_perf);
 
   auto old_root = v->par;
   if (is_right_zig) {
@@ -271,18 +1242,19 @@ void Model::zig(PNode v, PNode hidden_root, bool is_right_zig) {
   if (!hidden_root) {
     update_root(old_root, v);
   } else {
-    hidden_root->left = v;
+    reattach(hidden_root, old_root, v);
   }
-  port_out_.Set(std::make_pair(MsgCode::zig_end, data_.Get()));
+  notify(MsgCode::zig_end);
 }
 
-void Model::zig_zig(PNode v, PNode hidden_root, bool is_right_zig_zig) {
+void Model::zig_zig(PNode v, PNode hidden_root, bool is_right_zig_zig,
+                    bool semi) {
   if (is_right_zig_zig) {
     set_state(v, v->left, v->right, v->par->right, v->par->par->right);
   } else {
     set_state(v, v->par->par->left, v->par->left, v->left, v->right);
   }
-  port_out_.Set(std::make_pair(MsgCode::zigzig_perf, data_.Get()));
+  notify(MsgCode::zigzig_perf);
 
   auto old_root = v->par->par;
   if (is_right_zig_zig) {
@@ -291,14 +1263,18 @@ void Model::zig_zig(PNode v, PNode hidden_root, bool is_right_zig_zig) {
     rotate_left(v->par->par);
   }
 
-  if (!v->par->par) {
+  if (top(v->par)) {
     if (!hidden_root) {
       update_root(old_root, v->par);
     } else {
-      hidden_root->left = v->par;
+      reattach(hidden_root, old_root, v->par);
     }
   }
-  port_out_.Set(std::make_pair(MsgCode::zigzig_perf, data_.Get()));
+  if (semi) {
+    notify(MsgCode::zigzig_end);
+    return;
+  }
+  notify(MsgCode::zigzig_perf);
 
   old_root = v->par;
   if (is_right_zig_zig) {
@@ -307,14 +1283,14 @@ void Model::zig_zig(PNode v, PNode hidden_root, bool is_right_zig_zig) {
     rotate_left(v->par);
   }
 
-  if (!v->par) {
+  if (top(v)) {
     if (!hidden_root) {
       update_root(old_root, v);
     } else {
-      hidden_root->left = v;
+      reattach(hidden_root, old_root, v);
     }
   }
-  port_out_.Set(std::make_pair(MsgCode::zigzig_end, data_.Get()));
+  notify(MsgCode::zigzig_end);
 }
 
 void Model::zig_zag(PNode v, PNode hidden_root, bool is_right_left) {
@@ -323,14 +1299,14 @@ void Model::zig_zag(PNode v, PNode hidden_root, bool is_right_left) {
   } else {
     set_state(v, v->par->left, v->left, v->right, v->par->par->right);
   }
-  port_out_.Set(std::make_pair(MsgCode::zigzag_perf, data_.Get()));
+  notify(MsgCode::zigzag_perf);
 
   if (is_right_left) {
     rotate_right(v->par);
   } else {
     rotate_left(v->par);
   }
-  port_out_.Set(std::make_pair(MsgCode::zigzag_perf, data_.Get()));
+  notify(MsgCode::zigzag_perf);
 
   auto old_root = v->par;
   if (is_right_left) {
@@ -338,82 +1314,126 @@ void Model::zig_zag(PNode v, PNode hidden_root, bool is_right_left) {
   } else {
     rotate_right(v->par);
   }
-  if (!v->par) {
+  if (top(v)) {
     if (!hidden_root) {
       update_root(old_root, v);
     } else {
-      hidden_root->left = v;
+      reattach(hidden_root, old_root, v);
     }
   }
-  port_out_.Set(std::make_pair(MsgCode::zigzag_end, data_.Get()));
+  notify(MsgCode::zigzag_end);
+}
+
+bool Model::top(PNode v) {
+  return !v->par || (v->par->left != v && v->par->right != v);
+}
+
+void Model::reattach(PNode hidden_root, PNode old_top, PNode new_top) {
+  journal_.Touch(hidden_root);
+  if (hidden_root->left == old_top) {
+    hidden_root->left = new_top;
+  } else {
+    hidden_root->right = new_top;
+  }
 }
 
 void Model::set_state(PNode v, PNode A, PNode B, PNode C, PNode D) {
-  set_regular(v);
-  v->state = State::x_vertex;
-  v->par->state = State::p_vertex;
+  overlay_.Clear();
+  mark(v, State::x_vertex);
+  mark(v->par, State::p_vertex);
   if (v->par->par) {
-    v->par->par->state = State::g_vertex;
+    mark(v->par->par, State::g_vertex);
   }
   if (A) {
-    A->state = State::a_subtree;
+    mark(A, State::a_subtree);
   }
   if (B) {
-    B->state = State::b_subtree;
+    mark(B, State::b_subtree);
   }
   if (C) {
-    C->state = State::c_subtree;
+    mark(C, State::c_subtree);
   }
   if (D) {
-    D->state = State::d_subtree;
+    mark(D, State::d_subtree);
   }
 }
 
 void Model::update_root(PNode old_root, PNode new_root) {
-  int cur_key = -1;
-  for (auto &[key, root] : data_.Get()) {
-    if (root == old_root) {
-      cur_key = key;
-      break;
-    }
-  }
+  int cur_key = data_.OwnerOf(old_root);
   if (cur_key != -1) {
-    data_[cur_key] = new_root;
+    data_.Set(cur_key, new_root);
   }
 }
 
-Model::PNode Model::find(PNode v, int key) {
+Model::PNode Model::find(PNode v, int key, Access *access) {
   if (!v) {
     return v;
   }
   if (v->value == key) {
-    v->state = State::found;
-    port_out_.Set(std::make_pair(MsgCode::found, data_.Get()));
-    set_regular(v);
+    mark(v, State::found);
+    notify(MsgCode::found);
+    overlay_.Clear();
 
-    splay(v);
+    splay_by_policy(v, access);
     return v;
   }
   if (v->value > key && v->left) {
-    v->state = State::on_path;
-    port_out_.Set(std::make_pair(MsgCode::search, data_.Get()));
+    mark(v, State::on_path);
+    notify(MsgCode::search);
 
-    return find(v->left, key);
+    return find(v->left, key, access);
   }
   if (v->value < key && v->right) {
-    v->state = State::on_path;
-    port_out_.Set(std::make_pair(MsgCode::search, data_.Get()));
+    mark(v, State::on_path);
+    notify(MsgCode::search);
 
-    return find(v->right, key);
+    return find(v->right, key, access);
   }
 
-  v->state = State::not_found;
-  port_out_.Set(std::make_pair(MsgCode::not_found, data_.Get()));
+  mark(v, State::not_found);
+  notify(MsgCode::not_found);
 
-  splay(v);
+  splay_by_policy(v, access);
   return v;
 }
 
+void Model::splay_by_policy(PNode v, Access *access) {
+  if (!access) {
+    splay(v);
+    return;
+  }
+  int depth = 0;
+  for (auto u = v; u->par; u = u->par) {
+    ++depth;
+  }
+  auto before = rotations_;
+  auto &policy = access->policy;
+  switch (policy.kind) {
+  case SplayPolicy::Kind::full:
+    splay(v);
+    break;
+  case SplayPolicy::Kind::semi:
+    splay(v, nullptr, true);
+    break;
+  case SplayPolicy::Kind::depth:
+    if (depth > policy.depth) {
+      splay(v);
+    }
+    break;
+  case SplayPolicy::Kind::random:
+    if (std::bernoulli_distribution{policy.probability}(rng_)) {
+      splay(v);
+    }
+    break;
+  case SplayPolicy::Kind::none:
+    break;
+  }
+  auto done = rotations_ - before;
+  ++access->stats.finds;
+  access->stats.rotations += done;
+  access->stats.saved += depth - done;
+}
+
 std::pair<Model::PNode, Model::PNode> Model::split(PNode v, int key,
                                                    bool *res) {
   if (!v) {
@@ -422,15 +1442,17 @@ std::pair<Model::PNode, Model::PNode> Model::split(PNode v, int key,
     }
     return {nullptr, nullptr};
   }
-  set_regular(v);
-  port_out_.Set(std::make_pair(MsgCode::split_perf, data_.Get()));
+  overlay_.Clear();
+  notify(MsgCode::split_perf);
   v = find(v, key);
-  port_out_.Set(std::make_pair(MsgCode::split_perf, data_.Get()));
+  notify(MsgCode::split_perf);
   if (v->value == key) {
-    v->state = State::hide_this;
-    port_out_.Set(std::make_pair(MsgCode::split_perf, data_.Get()));
+    mark(v, State::hide_this);
+    notify(MsgCode::split_perf);
     auto ltree = v->left;
     auto rtree = v->right;
+    journal_.Touch(ltree);
+    journal_.Touch(rtree);
     if (ltree) {
       ltree->par = nullptr;
     }
@@ -443,9 +1465,11 @@ std::pair<Model::PNode, Model::PNode> Model::split(PNode v, int key,
     return {ltree, rtree};
   }
   if (v->value < key) {
-    v->state = State::split_right;
-    port_out_.Set(std::make_pair(MsgCode::split_perf, data_.Get()));
+    mark(v, State::split_right);
+    notify(MsgCode::split_perf);
     auto rtree = v->right;
+    journal_.Touch(v);
+    journal_.Touch(rtree);
     v->right = nullptr;
     if (rtree) {
       rtree->par = nullptr;
@@ -456,9 +1480,11 @@ std::pair<Model::PNode, Model::PNode> Model::split(PNode v, int key,
     }
     return {v, rtree};
   } else {
-    v->state = State::split_left;
-    port_out_.Set(std::make_pair(MsgCode::split_perf, data_.Get()));
+    mark(v, State::split_left);
+    notify(MsgCode::split_perf);
     auto ltree = v->left;
+    journal_.Touch(v);
+    journal_.Touch(ltree);
     v->left = nullptr;
     if (ltree) {
       ltree->par = nullptr;
@@ -473,8 +1499,8 @@ std::pair<Model::PNode, Model::PNode> Model::split(PNode v, int key,
 
 Model::PNode Model::insert(PNode v, int key, bool *res) {
   auto [ltree, rtree] = split(v, key, res);
-  if (v && v->state == State::hide_this) {
-    delete v;
+  if (v && overlay_.Get(v) == State::hide_this) {
+    journal_.Release(v);
   }
   PNode new_node{new Node<int>{.par = nullptr,
                                .left = ltree,
@@ -482,17 +1508,20 @@ Model::PNode Model::insert(PNode v, int key, bool *res) {
                                .value = key,
                                .min = key,
                                .max = key}};
+  journal_.Created(new_node);
+  journal_.Touch(ltree);
+  journal_.Touch(rtree);
   if (ltree) {
     ltree->par = new_node;
-    ltree->state = State::regular;
+    mark(ltree, State::regular);
   }
   if (rtree) {
     rtree->par = new_node;
-    rtree->state = State::regular;
+    mark(rtree, State::regular);
   }
   update(new_node);
-  set_regular(new_node);
-  new_node->state = State::inserted;
+  overlay_.Clear();
+  mark(new_node, State::inserted);
   return new_node;
 }
 
@@ -517,32 +1546,38 @@ Model::PNode Model::insert(PNode v, int key, bool *res) {
 // необходимо учитывать
 
 Model::PNode Model::merge(PNode hidden_root) {
-  port_out_.Set(std::make_pair(MsgCode::merge_perf, data_.Get()));
+  notify(MsgCode::merge_perf);
 
   auto ltree = hidden_root->left, rtree = hidden_root->right;
+  journal_.Touch(ltree);
+  journal_.Touch(rtree);
   if (!ltree) {
     if (rtree) {
       rtree->par = nullptr;
     }
-    delete hidden_root;
+    journal_.Release(hidden_root);
     return rtree;
   }
   ltree->par = nullptr;
+  // в последовательности по пути могут висеть отложенные развороты
+  push(ltree);
   while (ltree->right) {
-    ltree->state = State::on_path;
-    port_out_.Set(std::make_pair(MsgCode::r_search, data_.Get()));
+    mark(ltree, State::on_path);
+    notify(MsgCode::r_search);
     ltree = ltree->right;
+    push(ltree);
   }
-  ltree->state = State::found;
-  port_out_.Set(std::make_pair(MsgCode::r_found, data_.Get()));
+  mark(ltree, State::found);
+  notify(MsgCode::r_found);
   splay(ltree, hidden_root);
-  set_regular(hidden_root);
+  overlay_.Clear();
+  journal_.Touch(ltree);
   ltree->right = rtree;
   if (rtree) {
     rtree->par = ltree;
   }
   update(ltree);
-  delete hidden_root;
+  journal_.Release(hidden_root);
   return ltree;
 }
 
@@ -551,51 +1586,336 @@ Model::PNode Model::remove(PNode v, int key, bool *res) {
     return v;
   }
   v = find(v, key);
-  set_regular(v);
+  overlay_.Clear();
   if (v->value == key) {
     if (res) {
       *res = true;
     }
-    v->state = State::do_remove;
-    port_out_.Set(std::make_pair(MsgCode::do_rem, data_.Get()));
-    v->state = State::hide_this;
+    // вес остается у вершины, пока ее можно вернуть через undo
+    heat_.Touch(v);
+    mark(v, State::do_remove);
+    notify(MsgCode::do_rem);
+    mark(v, State::hide_this);
     return merge(v);
   }
 
-  v->state = State::dont_rem;
-  port_out_.Set(std::make_pair(MsgCode::dont_rem, data_.Get()));
+  mark(v, State::dont_rem);
+  notify(MsgCode::dont_rem);
   if (res) {
     *res = false;
   }
   return v;
 }
 
-void Model::set_regular(PNode root, PNode prev) {
-  if (!root) {
-    return;
+Model::PNode Model::at(PNode v, int index) {
+  while (true) {
+    // спускаюсь только по вершинам без отложенных операций, тогда повороты
+    // в splay их не перепутают
+    push(v);
+    int left = size_of(v->left);
+    if (index == left) {
+      break;
+    }
+    mark(v, State::on_path);
+    notify(MsgCode::search);
+    if (index < left) {
+      v = v->left;
+    } else {
+      index -= left + 1;
+      v = v->right;
+    }
   }
+  mark(v, State::found);
+  notify(MsgCode::found);
+  overlay_.Clear();
+  return v;
+}
 
-  if (root->left != prev) {
-    set_regular(root->left, root);
+// [l, r) собирается в одно поддерево: вершина l - 1 поднимается в корень,
+// а вершина r - в правого сына корня (splay внутри правого поддерева, где
+// корень играет роль hidden_root). Тогда отрезок - это левое поддерево
+// вершины r, и операция над ним - просто пометка его корня
+MsgCode Model::range(int id, int l, int r, bool rev, int add) {
+  if (!check_id(id)) {
+    return MsgCode::wrong_id;
+  }
+  if (!check_mode(id, Mode::sequence)) {
+    return MsgCode::mode_err;
+  }
+  Write write{this};
+  dirty(id);
+  int n = size_of(data_[id]);
+  if (l < 0 || l >= r || r > n) {
+    return finish(MsgCode::index_err);
+  }
+  PNode prev = nullptr, next = nullptr;
+  if (l > 0) {
+    prev = at(data_[id], l - 1);
+    splay(prev);
   }
-  if (root->right != prev) {
-    set_regular(root->right, root);
+  if (r < n && prev) {
+    auto sub = prev->right;
+    journal_.Touch(sub);
+    sub->par = nullptr;
+    next = at(sub, r - l);
+    splay(next, prev);
+    journal_.Touch(next);
+    next->par = prev;
+  } else if (r < n) {
+    next = at(data_[id], r);
+    splay(next);
   }
-  if (root->par != prev) {
-    set_regular(root->par, root);
+  auto segment = next ? next->left : prev ? prev->right : data_[id];
+  overlay_.Clear();
+  if (prev) {
+    mark(prev, State::split_left);
   }
+  if (next) {
+    mark(next, State::split_right);
+  }
+  mark(segment, State::push_tag);
+  notify(MsgCode::range_perf);
+  apply(segment, rev, add);
+  update(next);
+  update(prev);
+  overlay_.Clear();
+  return finish(MsgCode::OK);
+}
 
-  root->state = State::regular;
+Model::PNode Model::neighbour(PNode v, int key, bool below, bool strict,
+                             PNode *last) {
+  PNode res = nullptr;
+  while (v) {
+    mark(v, State::on_path);
+    notify(MsgCode::search);
+    if (last) {
+      *last = v;
+    }
+    bool fits = below ? v->value < key || (!strict && v->value == key)
+                      : v->value > key || (!strict && v->value == key);
+    if (fits) {
+      res = v;
+      v = below ? v->right : v->left;
+    } else {
+      v = below ? v->left : v->right;
+    }
+  }
+  overlay_.Clear();
+  return res;
+}
+
+MsgCode Model::bound(int id, int key, bool below, bool strict) {
+  if (!check_id(id)) {
+    return MsgCode::wrong_id;
+  }
+  if (!check_mode(id, Mode::values)) {
+    return MsgCode::mode_err;
+  }
+  Write write{this, Log::fold};
+  dirty(id);
+  PNode last = nullptr;
+  auto v = neighbour(data_[id], key, below, strict, &last);
+  // как и find, сплею то, до чего дошел, даже если ответа нет: иначе длинный
+  // неудачный спуск не окупится
+  if (!v) {
+    if (last) {
+      mark(last, State::not_found);
+      notify(MsgCode::not_found);
+      splay(last);
+    }
+    overlay_.Clear();
+    return finish(MsgCode::not_found);
+  }
+  mark(v, State::found);
+  notify(MsgCode::found);
+  splay(v);
+  heat_.Touch(v);
+  overlay_.Clear();
+  return answer(MsgCode::neighbour, {v->value});
+}
+
+// то же, что range для последовательности, только по ключам: самая правая
+// вершина с ключом < l поднимается в корень, самая левая с ключом > r - в
+// правого сына корня, и тогда [l, r] - это ровно левое поддерево второй.
+// Вместо удаления ключей по одному (find, splay и merge на каждый) это два
+// splay и одна перевеска поддерева, т.е. амортизированный O(log n), а сами
+// вершины освобождает журнал, когда ревизия уйдет из истории
+MsgCode Model::take_range(int id, int l, int r, bool keep) {
+  if (!check_id(id)) {
+    return MsgCode::wrong_id;
+  }
+  if (!check_mode(id, Mode::values)) {
+    return MsgCode::mode_err;
+  }
+  Write write{this};
+  dirty(id);
+  if (l > r) {
+    return finish(MsgCode::range_err);
+  }
+  auto prev = neighbour(data_[id], l, true);
+  if (prev) {
+    splay(prev);
+  }
+  PNode next = nullptr;
+  if (prev && prev->right) {
+    auto sub = prev->right;
+    journal_.Touch(sub);
+    sub->par = nullptr;
+    next = neighbour(sub, r, false);
+    if (next) {
+      splay(next, prev);
+    }
+    journal_.Touch(prev->right);
+    prev->right->par = prev;
+  } else if (!prev) {
+    next = neighbour(data_[id], r, false);
+    if (next) {
+      splay(next);
+    }
+  }
+  auto segment = next ? next->left : prev ? prev->right : data_[id];
+  if (!segment) {
+    overlay_.Clear();
+    return finish(MsgCode::range_empty);
+  }
+
+  overlay_.Clear();
+  if (prev) {
+    mark(prev, State::split_left);
+  }
+  if (next) {
+    mark(next, State::split_right);
+  }
+  mark(segment, keep ? State::new_root : State::do_remove);
+  notify(MsgCode::range_perf);
+
+  journal_.Touch(segment);
+  if (next) {
+    journal_.Touch(next);
+    next->left = nullptr;
+  } else if (prev) {
+    journal_.Touch(prev);
+    prev->right = nullptr;
+  }
+  segment->par = nullptr;
+  update(next);
+  update(prev);
+  data_.Set(id, prev ? prev : next);
+  thaw(id);
+  overlay_.Clear();
+
+  int count = segment->size;
+  if (!keep) {
+    journal_.ReleaseTree(segment);
+    return answer(MsgCode::erase_done, {count});
+  }
+  int new_id = data_.Insert(segment);
+  forget(new_id);
+  auto policy = access_of(id).policy;
+  access_of(new_id).policy = policy;
+  return answer(MsgCode::extract_done, {new_id, count});
+}
+
+Model::PNode Model::vertex(int v) {
+  if (v < 0 || v >= kMaxVertices) {
+    return nullptr;
+  }
+  if (vertices_.size() <= static_cast<size_t>(v)) {
+    vertices_.resize(v + 1);
+  }
+  if (!vertices_[v]) {
+    vertices_[v] = new Node<int>{.par = nullptr,
+                                 .left = nullptr,
+                                 .right = nullptr,
+                                 .value = v,
+                                 .min = v,
+                                 .max = v};
+  }
+  return vertices_[v];
+}
+
+void Model::show_forest(PNode top) {
+  if (data_.ModeOf(forest_id_) != Mode::forest) {
+    forest_id_ = data_.Insert(nullptr);
+    forget(forest_id_);
+    data_.SetMode(forest_id_, Mode::forest);
+  }
+  data_.Set(forest_id_, top);
+  dirty(forest_id_);
+}
+
+void Model::lct_splay(PNode v) {
+  // отложенные развороты (от make_root) проталкиваю сверху вниз до v, чтобы
+  // повороты в splay их не перепутали
+  lct_path_.assign(1, v);
+  while (!top(lct_path_.back())) {
+    lct_path_.push_back(lct_path_.back()->par);
+  }
+  // в слоте леса показываю то splay дерево, с которым сейчас работаю, тогда
+  // update_root в zig/zig_zig/zig_zag будет двигать и его
+  show_forest(lct_path_.back());
+  for (auto it = lct_path_.rbegin(); it != lct_path_.rend(); ++it) {
+    push(*it);
+  }
+  splay(v);
+}
+
+// после access путь от корня дерева до v - это одно splay дерево с корнем v,
+// а у v нет правого сына (более глубоких вершин на пути)
+void Model::access(PNode v) {
+  PNode last = nullptr;
+  for (auto u = v; u; u = u->par) {
+    lct_splay(u);
+    journal_.Touch(u);
+    // бывший правый сын остается ссылаться на u, т.е. становится сыном по
+    // родителю пути
+    u->right = last;
+    update(u);
+    last = u;
+  }
+  lct_splay(v);
+}
+
+void Model::make_root(PNode v) {
+  access(v);
+  apply(v, true, 0);
+}
+
+Model::PNode Model::find_root(PNode v) {
+  access(v);
+  push(v);
+  while (v->left) {
+    mark(v, State::on_path);
+    notify(MsgCode::r_search);
+    v = v->left;
+    push(v);
+  }
+  mark(v, State::found);
+  notify(MsgCode::r_found);
+  lct_splay(v);
+  return v;
 }
 
 Model::PNode Model::make_hidden_root(PNode ltree, PNode rtree) {
-  return new Node<int>{.par = nullptr,
-                       .left = ltree,
-                       .right = rtree,
-                       .value = ltree->max,
-                       .min = 0,
-                       .max = 0,
-                       .state = State::hide_this};
+  // после split по ключу меньше минимума левое дерево пустое
+  auto hidden_root =
+      new Node<int>{.par = nullptr,
+                    .left = ltree,
+                    .right = rtree,
+                    .value = ltree ? ltree->max : rtree ? rtree->min : 0,
+                    .min = 0,
+                    .max = 0};
+  mark(hidden_root, State::hide_this);
+  return hidden_root;
+}
+
+void Model::mark(PNode v, State state) {
+  // hide_this нужен самой модели, остальные пометки - только для кадров, и
+  // если кадры не отправляются (пакет без выборки), их можно не вести
+  if (state == State::hide_this ||
+      (!quiet_ && (!batch_ || batch_sample_ > 0))) {
+    overlay_.Mark(v, state);
+  }
 }
 
 } // namespace DSViz
@@ -1,84 +1,324 @@
 #ifndef MODEL_H
 #define MODEL_H
 #include "Common/node.h"
+#include "Common/policy.h"
+#include "Core/frame.h"
+#include "Core/frozen.h"
+#include "Core/heat.h"
+#include "Core/journal.h"
+#include "Core/optimal.h"
+#include "Core/overlay.h"
+#include "Core/trees.h"
 #include "Observer/observer.h"
+#include <atomic>
+#include <climits>
+#include <cstdint>
+#include <random>
+#include <shared_mutex>
+#include <thread>
 
 namespace DSViz {
 
-namespace detail {
-
-class Trees {
-  using PNode = Node<int> *;
-  using BareTrees = std::map<int, PNode>;
-
-public:
-  Trees() = default;
-  ~Trees();
-
-  Trees(const Trees &) = delete;
-  Trees &operator=(const Trees &) = delete;
-  Trees(Trees &&) = delete;
-  Trees &operator=(Trees &&) = delete;
-
-  void Insert(int id, PNode node);
-
-  void DeleteTree(int id);
-  void DiscardTree(int id);
-
-  size_t Size() const;
-
-  PNode &operator[](int key);
-
-  const BareTrees &Get();
-
-private:
-  void destroy(PNode node);
-
-  BareTrees trees_;
-};
-
-} // namespace detail
+class Profiler;
 
 class Model {
   using Trees = detail::Trees;
+  using Mode = Trees::Mode;
+  using Journal = detail::Journal;
+  using Overlay = detail::Overlay;
+  using FrozenTree = detail::FrozenTree;
   using PNode = Node<int> *;
-  using BareTrees = std::map<int, PNode>;
-  using MsgType = std::pair<MsgCode, BareTrees>;
+  using MsgType = Frame;
 
 public:
   Model();
+  ~Model();
+
+  Model(const Model &) = delete;
+  Model &operator=(const Model &) = delete;
+
+  // все операции возвращают код своего итогового кадра
+  MsgCode Insert(int id, int key);
+
+  MsgCode Remove(int id, int key);
+
+  MsgCode Merge(int left_id, int right_id);
+
+  MsgCode Split(int id, int key);
+
+  // все ключи из [l, r] одним куском: Extract переносит их в новое дерево
+  // (его id и число ключей приходят в Frame::values), Erase удаляет
+  // (отменяется через undo, как и deltree). Дерево id после этого - остаток
+  MsgCode ExtractRange(int id, int l, int r);
+  MsgCode EraseRange(int id, int l, int r);
+
+  // splay = false - обычный спуск по BST без перестройки, независимо от
+  // политики дерева (кадры поиска при этом отправляются как обычно)
+  MsgCode ExistKey(int id, int key, bool splay = true);
+
+  // поиск без splay и без кадров. В отличие от остальных методов его можно
+  // звать из нескольких потоков сразу: читатели делят блокировку, а любая
+  // операция, которая меняет деревья, берет ее монопольно. Для
+  // последовательностей и леса возвращает false
+  bool Contains(int id, int key) const;
+
+  // соседние ключи: LowerBound - наименьший >= key, UpperBound и Successor
+  // (одно и то же) - наименьший > key, Predecessor - наибольший < key.
+  // Найденный ключ приходит в Frame::values и сплеится в корень, как при find,
+  // если такого нет - сплеится последняя вершина спуска и ответ not_found
+  MsgCode LowerBound(int id, int key);
+  MsgCode UpperBound(int id, int key);
+  MsgCode Successor(int id, int key);
+  MsgCode Predecessor(int id, int key);
+
+  // обход ключей дерева по возрастанию порциями, без рекурсии (идет по par).
+  // Между порциями дерево можно менять: курсор помнит версию дерева
+  // (Trees::Version), и если она поменялась, заново спускается к первому
+  // ключу больше последнего выданного.
+  //
+  // Без splay курсор только читает под общей блокировкой, как Contains. Со
+  // splay каждая выданная вершина сплеится в корень (без кадров), и тогда
+  // полный обход стоит O(n) поворотов (sequential access у splay дерева), а
+  // дерево после него готово к следующему последовательному проходу
+  class Cursor {
+  public:
+    // пишет в out следующие не больше count ключей, 0 - ключи кончились
+    size_t Next(int *out, size_t count);
+    bool Done() const;
+
+  private:
+    friend class Model;
+    Cursor(Model *model, int id, int from, bool splay);
+
+    size_t step(int *out, size_t count);
+    PNode seek() const;
+
+    Model *model_;
+    int id_;
+    bool splay_;
+    // ключ, с которого начинать, пока ничего не выдано, потом - последний
+    // выданный
+    int last_;
+    bool started_ = {};
+    bool done_ = {};
+    PNode pos_ = {};
+    uint64_t version_ = {};
+  };
+
+  Cursor Scan(int id, int from = INT_MIN, bool splay = false);
+
+  MsgCode DeleteTree(int id);
+
+  // загрузка готового множества ключей (по возрастанию и без повторов, как
+  // их выдает KeyFile). id = -1 - в новое дерево, иначе ключи добавляются в
+  // дерево id. Вместо вставок по одной дерево за O(n + m) собирается заново
+  // идеально сбалансированным (старые вершины переиспользуются), кадр один -
+  // load_done с id дерева и числом новых ключей в Frame::values
+  MsgCode Load(int id, const std::vector<int> &keys);
+
+  // замораживает множество ключей дерева для пакетного поиска без splay (см.
+  // FrozenTree). После изменения дерева копия перестраивается при следующем
+  // поиске, так что заморозка действует, пока дерево не удалят
+  MsgCode Freeze(int id);
+  // если дерево заморожено, пишет в out found/not_found для каждого ключа и
+  // возвращает true. Кадров не отправляет и дерево не трогает. Как и
+  // Contains, можно звать из нескольких потоков: свежую копию читают под
+  // общей блокировкой, а устаревшую перестраивают под монопольной
+  bool Lookup(int id, const int *keys, size_t count, MsgCode *out);
+
+  // политика splay для ExistKey в дереве id, счетчики при этом обнуляются.
+  // Дерево, отрезанное split, наследует политику исходного
+  MsgCode SetPolicy(int id, const SplayPolicy &policy);
+  // счетчики политики, peek (ExistKey без splay) в них не входит
+  SplayStats Stats(int id) const;
+
+  // запись поисков (ExistKey) по дереву id для сравнения со статическим
+  // деревом. Новая запись начинается с чистого листа и с текущей формы
+  // дерева, остановка отвечает trace_off с числом записанных поисков
+  MsgCode Record(int id, bool on);
+  // статическое дерево по частотам записи: точное (Кнут) до
+  // OptimalBst::kKnuthMax ключей, дальше приближение Мельхорна. Оно
+  // появляется отдельным деревом с политикой none, а запись прогоняется и
+  // через него, и через splay с той формы, с которой началась. Ответ
+  // optimal_done, в Frame::values: id нового дерева, точное ли оно, число
+  // поисков, среднее число сравнений на поиск у splay и у статического дерева
+  // (в сотых). Если дерево меняли во время записи, сравнение приблизительное
+  MsgCode BuildOptimal(int id);
+
+  // счетчики обращений к вершинам для тепловой карты (см. HeatClock). Пока
+  // она выключена, обращения не считаются вовсе, а выключение забывает все
+  // веса. HeatMap - то же самое запросом, с кадром heat_on/heat_off
+  void EnableHeat(bool on);
+  MsgCode HeatMap(bool on);
+  // затухание счетчиков: за accesses обращений вес падает вдвое, 0 - веса
+  // только растут. Сами счетчики обновляют find, peek (и пакетные поиски по
+  // замороженной копии), insert, remove и поиск соседей; вершина, удаленная
+  // remove, уносит свой счетчик с собой. Часы приходят в Frame::heat
+  MsgCode SetHeatHalfLife(int accesses);
+
+  // режим последовательности (см. Trees::Mode). Обычное дерево можно
+  // превратить в последовательность его значений в порядке обхода, обратно
+  // нельзя. Конкатенация - это обычный Merge двух последовательностей
+  MsgCode MakeSequence(int id);
+  MsgCode InsertAt(int id, int index, int value);
+  MsgCode EraseAt(int id, int index);
+  // в дереве id остаются первые index элементов
+  MsgCode SplitAt(int id, int index);
+  // развернуть/прибавить delta на [l, r)
+  MsgCode Reverse(int id, int l, int r);
+  MsgCode AddRange(int id, int l, int r, int delta);
+
+  // лес link-cut на тех же splay примитивах: каждый предпочтительный путь -
+  // это splay дерево с ключом по глубине, а его корень хранит в par родителя
+  // пути (настоящий сын отличается тем, что отец на него ссылается). Вершины
+  // - числа [0, kMaxVertices), создаются при первом упоминании, значение
+  // вершины - ее номер. Лес один на модель, и показывается он через
+  // отдельный слот реестра (Trees::Mode::forest), в котором лежит splay
+  // дерево последнего пройденного пути.
+  //
+  // access сплеит на каждом шаге, так что без animate лес работает без
+  // пометок и промежуточных кадров, отправляется только итоговый
+  MsgCode Link(int u, int v, bool animate = false);
+  MsgCode Cut(int u, int v, bool animate = false);
+  // ответ (номер корня) приходит в Frame::values
+  MsgCode FindRoot(int v, bool animate = false);
+  MsgCode Connected(int u, int v, bool animate = false);
+  // число вершин на пути u-v, минимальный и максимальный номер на нем
+  MsgCode PathAggregate(int u, int v, bool animate = false);
+  // слот, в котором показывается лес, либо -1
+  int ForestId() const;
+
+  static constexpr const int kMaxVertices = 1 << 24;
+
+  // отмена/повтор последней операции (пакет считается одной операцией).
+  // Поиски своих шагов не имеют: их повороты отменяются вместе с прошлой
+  // операцией
+  MsgCode Undo();
+  MsgCode Redo();
+  // сколько операций можно отменить, 0 - история не ведется вовсе
+  void SetUndoLimit(size_t revisions);
+
+  // пакетный режим: пока он включен, промежуточные кадры не отправляются (или
+  // отправляется только каждый sample-й), а EndBatch отправляет один кадр
+  // batch_done с результатами всех запросов пакета
+  void BeginBatch(int sample = 0);
+  void EndBatch(std::vector<MsgCode> results);
 
-  void Insert(int id, int key);
-
-  void Remove(int id, int key);
-
-  void Merge(int left_id, int right_id);
-
-  void Split(int id, int key);
+  void SubscribeToBareTree(Observer<MsgType> *view_observer);
 
-  void ExistKey(int id, int key);
+  // идет ли операция в этом потоке. Кадры доставляются синхронно, так что
+  // подписчик (или вложенный цикл событий View::Delay) может прислать новый
+  // запрос, пока текущая операция не закончилась, и тогда его надо отложить
+  // или отбросить: дерево сейчас посреди поворотов
+  bool Busy() const;
 
-  void DeleteTree(int id);
-
-  void SubscribeToBareTree(Observer<MsgType> *view_observer);
+  // счетчики процессора по операциям (см. Profiler), nullptr - выключены.
+  // Пока отправляется кадр, счет стоит на паузе, а если профилировщик
+  // просит, отдельно меряется каждый splay
+  void SetProfiler(Profiler *profiler);
+  Profiler *GetProfiler() const;
+  // сколько всего сделано поворотов
+  long long Rotations() const;
 
 private:
+  // что операция оставляет в истории undo: свою ревизию, ничего (undo/redo,
+  // настройки) или повороты, дописанные к прошлой ревизии (запросы, которые
+  // только читают, но сплеят)
+  enum class Log { revision, none, fold };
+
+  // операция, которая меняет деревья: одна ревизия журнала и монопольная
+  // блокировка. Вложенные Write, как и ревизии журнала, сливаются с внешней
+  class Write {
+  public:
+    explicit Write(Model *model, Log log = Log::revision);
+    ~Write();
+
+    Write(const Write &) = delete;
+    Write &operator=(const Write &) = delete;
+
+  private:
+    Model *model_;
+    Log log_;
+  };
+  void lock_write();
+  void unlock_write();
+
+  // пока жив, промежуточные кадры не отправляются и пометки не ведутся (см.
+  // quiet_). Итоговый кадр операции (finish, answer) уходит все равно
+  class Quiet {
+  public:
+    Quiet(Model *model, bool on);
+    ~Quiet();
+
+    Quiet(const Quiet &) = delete;
+    Quiet &operator=(const Quiet &) = delete;
+
+  private:
+    Model *model_;
+    bool old_;
+  };
+
   void update(PNode v);
+  // проталкивает отложенные rev и add вершины v в ее детей
+  void push(PNode v);
+  void apply(PNode v, bool rev, int add);
+  static int size_of(PNode v);
   void rotate_left(PNode v);
   void rotate_right(PNode v);
 
   // что такое hidden_root стоит посмотреть перед определением функции merge.
-  void splay(PNode v, PNode hidden_root = nullptr);
+  void splay(PNode v, PNode hidden_root = nullptr, bool semi = false);
   void zig(PNode v, PNode hidden_root, bool is_right_zig);
-  void zig_zig(PNode v, PNode hidden_root, bool is_right_zig_zig);
+  // при semi делается только первый поворот (родителя вокруг деда)
+  void zig_zig(PNode v, PNode hidden_root, bool is_right_zig_zig,
+               bool semi = false);
   void zig_zag(PNode v, PNode hidden_root, bool is_right_left);
+  // v - корень своего splay дерева: у нее нет отца, либо (в лесе link-cut)
+  // отец не ссылается на нее как на сына
+  static bool top(PNode v);
+  // у hidden_root поменялся сын old_top (левый или правый) на new_top
+  void reattach(PNode hidden_root, PNode old_top, PNode new_top);
+
+  // last - итоговый кадр операции, его не глушит quiet_
+  void send(Frame frame, bool last = false);
+  void notify(MsgCode code, const SplayStats *splay = nullptr);
+  MsgCode finish(MsgCode code, const SplayStats *splay = nullptr);
+  MsgCode answer(MsgCode code, std::vector<int> values);
+  // id приходят снаружи (сценарии, генераторы нагрузки), так что их надо
+  // проверять. Если дерева нет, отправляет wrong_id
+  bool check_id(int id);
+  // дерево id изменилось / id освободился или достался новому дереву
+  void thaw(int id);
+  // есть ли у дерева id замороженная копия (возможно, устаревшая)
+  bool frozen(int id) const;
+  // Lookup без блокировки. Устаревшую копию перестраивает, так что под общей
+  // блокировкой ее можно звать только для свежей
+  bool lookup(int id, const int *keys, size_t count, MsgCode *out);
+  // идет ли запись поисков по дереву id (см. Record)
+  bool recording(int id) const;
+  // вершина с ключом key: обычный спуск, без splay, пометок и кадров
+  static PNode descend(PNode v, int key);
+  void forget(int id);
+  // дерево id меняется текущей операцией: пока она идет, каждый кадр
+  // поднимает его версию (Trees::Version), по которой View кэширует раскладки
+  void dirty(int id);
 
   void set_state(PNode v, PNode A, PNode B, PNode C, PNode D = nullptr);
   void update_root(PNode old_root, PNode new_root);
 
   // find, insert, merge и т.д. я пишу не в camel case чтобы не было путаницы с
   // публичными методами
-  PNode find(PNode v, int key);
+  struct Access {
+    SplayPolicy policy;
+    SplayStats stats;
+    detail::AccessTrace trace;
+  };
+  Access &access_of(int id);
+
+  // если access задан, найденная вершина сплеится по политике дерева, иначе
+  // всегда до корня
+  PNode find(PNode v, int key, Access *access = nullptr);
+  void splay_by_policy(PNode v, Access *access);
 
   std::pair<PNode, PNode> split(PNode v, int key, bool *res = nullptr);
 
@@ -88,13 +328,69 @@ private:
 
   PNode remove(PNode v, int key, bool *res = nullptr);
 
-  void set_regular(PNode root, PNode prev = nullptr);
 
-  static PNode make_hidden_root(PNode ltree, PNode rtree);
+  // вершина на позиции index в поддереве v (без splay), 0 <= index < size
+  PNode at(PNode v, int index);
+  MsgCode range(int id, int l, int r, bool rev, int add);
+  // самая правая вершина с ключом < key (below) или самая левая с ключом >
+  // key, без splay
+  // strict = false - то же, но ключ может быть равен key
+  PNode neighbour(PNode v, int key, bool below, bool strict = true,
+                  PNode *last = nullptr);
+  MsgCode bound(int id, int key, bool below, bool strict);
+  MsgCode take_range(int id, int l, int r, bool keep);
+  // сбалансированное дерево из count вершин, уже упорядоченных по ключу.
+  // Журнал не трогает: старые вершины должен отметить вызывающий
+  PNode build(PNode *nodes, int count, PNode par);
+  // проверка режима дерева, при несовпадении отправляет mode_err
+  bool check_mode(int id, Mode mode);
+
+  // лес link-cut
+  PNode vertex(int v);
+  void show_forest(PNode top);
+  void lct_splay(PNode v);
+  void access(PNode v);
+  void make_root(PNode v);
+  PNode find_root(PNode v);
+
+  // hidden_root сразу помечается hide_this
+  PNode make_hidden_root(PNode ltree, PNode rtree);
+  void mark(PNode v, State state);
 
   Trees data_ = {};
+  // раньше журнала: он вычеркивает из часов освобождаемые вершины, в том
+  // числе в своем деструкторе
+  detail::HeatClock heat_ = {};
+  Journal journal_{&data_, &heat_};
+  // состояния вершин для кадров (см. Overlay), сбрасываются после операции
+  Overlay overlay_ = {};
+  // индекс - id дерева
+  std::vector<FrozenTree> frozen_ = {};
+  std::vector<Access> access_ = {};
+  // сид фиксированный, чтобы прогоны со случайным splay повторялись
+  std::mt19937 rng_{kPolicySeed};
+  long long rotations_ = {};
+  Profiler *profiler_ = {};
+  std::vector<PNode> vertices_ = {};
+  std::vector<PNode> lct_path_ = {};
+  int forest_id_ = -1;
+
+  static constexpr const unsigned kPolicySeed = 1;
   Observable<MsgType> port_out_ = {};
-  int next_id_ = {};
+  bool batch_ = {};
+  // курсор со splay и лес без анимации: промежуточные кадры не отправляются
+  // и пометки не ведутся
+  bool quiet_ = {};
+  int batch_sample_ = {};
+  int batch_frames_ = {};
+  mutable std::shared_mutex mutex_;
+  // поток, который держит блокировку монопольно, и глубина вложенных Write в
+  // нем. Вложенным считается только Write из того же потока, другой поток
+  // ждет на mutex_
+  std::atomic<std::thread::id> owner_ = {};
+  int writers_ = {};
+  // деревья, которые меняет текущая операция (см. dirty)
+  std::vector<int> dirty_ = {};
 };
 
 } // namespace DSViz
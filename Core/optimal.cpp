@@ -0,0 +1,257 @@
+#include "Core/optimal.h"
+#include <algorithm>
+#include <cstdlib>
+#include <utility>
+
+namespace DSViz {
+
+namespace detail {
+
+void AccessTrace::Start(PNode root) {
+  keys_.clear();
+  shape_.clear();
+  std::vector<PNode> stack;
+  if (root) {
+    stack.push_back(root);
+  }
+  while (!stack.empty()) {
+    auto v = stack.back();
+    stack.pop_back();
+    shape_.push_back(v->value);
+    if (v->right) {
+      stack.push_back(v->right);
+    }
+    if (v->left) {
+      stack.push_back(v->left);
+    }
+  }
+  recording_ = true;
+}
+
+void AccessTrace::Stop() { recording_ = false; }
+
+void AccessTrace::Add(int key) { keys_.push_back(key); }
+
+bool AccessTrace::Recording() const { return recording_; }
+
+const std::vector<int> &AccessTrace::Keys() const { return keys_; }
+
+const std::vector<int> &AccessTrace::Shape() const { return shape_; }
+
+// отрезки ключей [i, j] нумерую с единицы, пустой отрезок [i, i - 1] стоит 0.
+// Вес отрезка - все поиски, которые в него попадают, вместе с промахами
+// между его ключами и по краям: каждая вершина на пути спуска добавляет одно
+// сравнение всем поискам своего поддерева
+std::vector<int> OptimalBst::Knuth(const std::vector<int> &keys,
+                                   const std::vector<long long> &hits,
+                                   const std::vector<long long> &misses) {
+  size_t n = keys.size();
+  std::vector<long long> prefix_hits(n + 1), prefix_misses(n + 2);
+  for (size_t k = 0; k < n; ++k) {
+    prefix_hits[k + 1] = prefix_hits[k] + hits[k];
+  }
+  for (size_t k = 0; k <= n; ++k) {
+    prefix_misses[k + 1] = prefix_misses[k] + misses[k];
+  }
+  auto weight = [&](size_t i, size_t j) {
+    return prefix_hits[j] - prefix_hits[i - 1] + prefix_misses[j + 1] -
+           prefix_misses[i - 1];
+  };
+
+  size_t side = n + 2;
+  std::vector<long long> cost(side * side);
+  std::vector<int> root(side * side);
+  auto at = [side](size_t i, size_t j) { return i * side + j; };
+  for (size_t len = 1; len <= n; ++len) {
+    for (size_t i = 1; i + len - 1 <= n; ++i) {
+      size_t j = i + len - 1;
+      size_t lo = len == 1 ? i : root[at(i, j - 1)];
+      size_t hi = len == 1 ? i : root[at(i + 1, j)];
+      long long best = -1;
+      for (size_t r = lo; r <= hi; ++r) {
+        long long cur = cost[at(i, r - 1)] + cost[at(r + 1, j)];
+        if (best < 0 || cur < best) {
+          best = cur;
+          root[at(i, j)] = static_cast<int>(r);
+        }
+      }
+      cost[at(i, j)] = best + weight(i, j);
+    }
+  }
+
+  std::vector<int> preorder;
+  preorder.reserve(n);
+  std::vector<std::pair<size_t, size_t>> stack;
+  if (n > 0) {
+    stack.push_back({1, n});
+  }
+  while (!stack.empty()) {
+    auto [i, j] = stack.back();
+    stack.pop_back();
+    size_t r = root[at(i, j)];
+    preorder.push_back(keys[r - 1]);
+    if (r < j) {
+      stack.push_back({r + 1, j});
+    }
+    if (r > i) {
+      stack.push_back({i, r - 1});
+    }
+  }
+  return preorder;
+}
+
+// веса идут вперемешку: промах 0, ключ 0, промах 1, ..., ключ n - 1, промах
+// n. К каждому весу добавляю единицу, а настоящие частоты умножаю на число
+// весов: на выбор корня это влияет только при равенстве, зато ключи, которые
+// ни разу не искали, не вытягиваются в бамбук
+std::vector<int> OptimalBst::Mehlhorn(const std::vector<int> &keys,
+                                      const std::vector<long long> &hits,
+                                      const std::vector<long long> &misses) {
+  size_t n = keys.size();
+  long long scale = static_cast<long long>(2 * n + 2);
+  std::vector<long long> prefix(2 * n + 2);
+  for (size_t t = 0; t < 2 * n + 1; ++t) {
+    long long count = t % 2 == 0 ? misses[t / 2] : hits[t / 2];
+    prefix[t + 1] = prefix[t] + count * scale + 1;
+  }
+  std::vector<int> preorder;
+  preorder.reserve(n);
+  bisect(keys, prefix, 0, n, &preorder);
+  return preorder;
+}
+
+// ключи [l, r), промахи с l по r. Слева от корня m лежат веса с номерами от
+// 2l до 2m, справа - от 2m + 2 до 2r. Разность левого и правого растет с m,
+// так что ищу первый m, где левый перевесил, и сравниваю с соседом
+void OptimalBst::bisect(const std::vector<int> &keys,
+                        const std::vector<long long> &prefix, size_t l,
+                        size_t r, std::vector<int> *out) {
+  if (l >= r) {
+    return;
+  }
+  auto diff = [&](size_t m) {
+    return (prefix[2 * m + 1] - prefix[2 * l]) -
+           (prefix[2 * r + 1] - prefix[2 * m + 2]);
+  };
+  size_t lo = l, hi = r - 1;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (diff(mid) >= 0) {
+      hi = mid;
+    } else {
+      lo = mid + 1;
+    }
+  }
+  size_t m = lo;
+  if (m > l && std::llabs(diff(m - 1)) < std::llabs(diff(m))) {
+    --m;
+  }
+  out->push_back(keys[m]);
+  bisect(keys, prefix, l, m, out);
+  bisect(keys, prefix, m + 1, r, out);
+}
+
+TraceReplay::TraceReplay(const std::vector<int> &preorder) {
+  vertices_.reserve(preorder.size());
+  std::vector<int> stack;
+  for (int key : preorder) {
+    int v = static_cast<int>(vertices_.size());
+    vertices_.push_back(Vertex{key});
+    if (stack.empty()) {
+      root_ = v;
+    } else if (key < vertices_[stack.back()].key) {
+      vertices_[stack.back()].left = v;
+      vertices_[v].par = stack.back();
+    } else {
+      int par = -1;
+      while (!stack.empty() && vertices_[stack.back()].key < key) {
+        par = stack.back();
+        stack.pop_back();
+      }
+      vertices_[par].right = v;
+      vertices_[v].par = par;
+    }
+    stack.push_back(v);
+  }
+}
+
+long long TraceReplay::Splay(const std::vector<int> &trace) {
+  long long compares = 0;
+  for (int key : trace) {
+    int v = descend(key, &compares);
+    if (v != -1) {
+      splay(v);
+    }
+  }
+  return compares;
+}
+
+long long TraceReplay::Static(const std::vector<int> &trace) const {
+  long long compares = 0;
+  for (int key : trace) {
+    descend(key, &compares);
+  }
+  return compares;
+}
+
+int TraceReplay::descend(int key, long long *compares) const {
+  int last = -1;
+  for (int v = root_; v != -1;) {
+    ++*compares;
+    last = v;
+    if (vertices_[v].key == key) {
+      break;
+    }
+    v = key < vertices_[v].key ? vertices_[v].left : vertices_[v].right;
+  }
+  return last;
+}
+
+void TraceReplay::rotate(int v) {
+  auto &x = vertices_[v];
+  int p = x.par;
+  auto &y = vertices_[p];
+  int g = y.par;
+  if (y.left == v) {
+    y.left = x.right;
+    if (x.right != -1) {
+      vertices_[x.right].par = p;
+    }
+    x.right = p;
+  } else {
+    y.right = x.left;
+    if (x.left != -1) {
+      vertices_[x.left].par = p;
+    }
+    x.left = p;
+  }
+  y.par = v;
+  x.par = g;
+  if (g == -1) {
+    root_ = v;
+  } else if (vertices_[g].left == p) {
+    vertices_[g].left = v;
+  } else {
+    vertices_[g].right = v;
+  }
+}
+
+void TraceReplay::splay(int v) {
+  while (vertices_[v].par != -1) {
+    int p = vertices_[v].par;
+    int g = vertices_[p].par;
+    if (g == -1) {
+      rotate(v);
+    } else if ((vertices_[p].left == v) == (vertices_[g].left == p)) {
+      rotate(p);
+      rotate(v);
+    } else {
+      rotate(v);
+      rotate(v);
+    }
+  }
+}
+
+} // namespace detail
+
+} // namespace DSViz
@@ -0,0 +1,94 @@
+#ifndef OPTIMAL_H
+#define OPTIMAL_H
+#include "Common/node.h"
+#include <cstddef>
+#include <vector>
+
+namespace DSViz {
+
+namespace detail {
+
+// поиски по дереву, записанные для сравнения со статическим деревом (см.
+// Model::Record). Кроме самих ключей помню форму дерева на момент начала
+// записи - ключи в прямом порядке обхода, по ним BST восстанавливается
+// однозначно, - чтобы прогнать запись через splay с того же дерева, с
+// которого она началась
+class AccessTrace {
+  using PNode = Node<int> *;
+
+public:
+  void Start(PNode root);
+  void Stop();
+  void Add(int key);
+
+  bool Recording() const;
+  const std::vector<int> &Keys() const;
+  const std::vector<int> &Shape() const;
+
+private:
+  std::vector<int> keys_;
+  std::vector<int> shape_;
+  bool recording_ = {};
+};
+
+// статическое дерево поиска под заданные частоты. keys - ключи по
+// возрастанию, hits[i] - сколько раз искали keys[i], misses[j] - сколько раз
+// искали отсутствующий ключ между keys[j - 1] и keys[j] (j от 0 до n).
+// Стоимость поиска - число сравнений, то есть вершин на пути спуска. Форма
+// возвращается как ключи в прямом порядке обхода
+class OptimalBst {
+public:
+  // Кнут: точный оптимум, O(n^2) времени и памяти (корень отрезка лежит
+  // между корнями двух отрезков на единицу короче)
+  static std::vector<int> Knuth(const std::vector<int> &keys,
+                                const std::vector<long long> &hits,
+                                const std::vector<long long> &misses);
+  // Мельхорн: корнем берется ключ, который делит вес отрезка пополам (он
+  // ищется двоичным поиском по префиксным суммам), O(n log n). Средняя
+  // стоимость не больше энтропии распределения плюс пара сравнений
+  static std::vector<int> Mehlhorn(const std::vector<int> &keys,
+                                   const std::vector<long long> &hits,
+                                   const std::vector<long long> &misses);
+
+  // до скольких ключей строится точное дерево
+  static constexpr const size_t kKnuthMax = 1024;
+
+private:
+  static void bisect(const std::vector<int> &keys,
+                     const std::vector<long long> &prefix, size_t l,
+                     size_t r, std::vector<int> *out);
+};
+
+// прогон записи по копии дерева на своем массиве вершин: модель при этом не
+// трогается (ни кадров, ни журнала, ни блокировок). Считает сравнения
+class TraceReplay {
+public:
+  explicit TraceReplay(const std::vector<int> &preorder);
+
+  // найденная вершина (или последняя вершина спуска, если ключа нет)
+  // сплеится в корень, как при find с политикой full
+  long long Splay(const std::vector<int> &trace);
+  // дерево не меняется
+  long long Static(const std::vector<int> &trace) const;
+
+private:
+  struct Vertex {
+    int key;
+    int left = -1;
+    int right = -1;
+    int par = -1;
+  };
+
+  // последняя вершина спуска, сравнения прибавляются к *compares
+  int descend(int key, long long *compares) const;
+  void rotate(int v);
+  void splay(int v);
+
+  std::vector<Vertex> vertices_;
+  int root_ = -1;
+};
+
+} // namespace detail
+
+} // namespace DSViz
+#endif // OPTIMAL_H
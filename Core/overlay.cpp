@@ -0,0 +1,47 @@
+#include "Core/overlay.h"
+
+namespace DSViz {
+
+namespace detail {
+
+void Overlay::Mark(PNode v, State state) {
+  if (!v) {
+    return;
+  }
+  if (state == State::hide_this) {
+    hidden_.insert(v);
+  }
+  marks_[v] = state;
+}
+
+State Overlay::Get(PNode v) const {
+  if (auto it = marks_.find(v); it != marks_.end()) {
+    return it->second;
+  }
+  return hidden_.count(v) ? State::hide_this : State::regular;
+}
+
+void Overlay::Clear() { marks_.clear(); }
+
+void Overlay::Reset() {
+  marks_.clear();
+  hidden_.clear();
+}
+
+bool Overlay::Empty() const { return marks_.empty() && hidden_.empty(); }
+
+std::unordered_map<Overlay::PNode, State> Overlay::Collect() const {
+  std::unordered_map<PNode, State> res;
+  res.reserve(marks_.size() + hidden_.size());
+  for (auto v : hidden_) {
+    res[v] = State::hide_this;
+  }
+  for (auto &[v, state] : marks_) {
+    res[v] = state;
+  }
+  return res;
+}
+
+} // namespace detail
+
+} // namespace DSViz
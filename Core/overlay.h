@@ -0,0 +1,44 @@
+#ifndef OVERLAY_H
+#define OVERLAY_H
+#include "Common/node.h"
+#include <unordered_map>
+#include <unordered_set>
+
+namespace DSViz {
+
+namespace detail {
+
+// пометки вершин для анимации, отдельно от самих вершин. Раньше State лежал
+// прямо в Node, и модель на каждом шаге перекрашивала дерево (set_regular
+// обходил его целиком), а View еще и дописывал состояния при отрисовке.
+// Теперь это разреженная таблица вершина -> State при кадре: более поздняя
+// пометка вершины перекрывает раннюю, непомеченные вершины - regular.
+//
+// hide_this - не только цвет: по нему модель узнает удаленную вершину и
+// hidden_root, так что такие вершины остаются скрытыми до конца операции и
+// Clear их не снимает. Они лежат отдельно, чтобы Clear не переписывал их на
+// каждом кадре: в пакете из тысяч remove их набирается столько же
+class Overlay {
+  using PNode = const Node<int> *;
+
+public:
+  void Mark(PNode v, State state);
+  State Get(PNode v) const;
+  // снимает все пометки, кроме hide_this
+  void Clear();
+  // снимает вообще все (конец операции, undo/redo)
+  void Reset();
+  bool Empty() const;
+
+  // итоговое состояние каждой помеченной вершины, включая скрытые
+  std::unordered_map<PNode, State> Collect() const;
+
+private:
+  std::unordered_map<PNode, State> marks_;
+  std::unordered_set<PNode> hidden_;
+};
+
+} // namespace detail
+
+} // namespace DSViz
+#endif // OVERLAY_H
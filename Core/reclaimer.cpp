@@ -0,0 +1,109 @@
+#include "Core/reclaimer.h"
+#include <utility>
+
+namespace DSViz {
+
+Reclaimer &Reclaimer::Instance() {
+  static Reclaimer instance;
+  return instance;
+}
+
+bool Reclaimer::Job::Done() const { return !root && next == nodes.size(); }
+
+void Reclaimer::RetireTree(PNode root) {
+  if (root) {
+    push(Job{root});
+  }
+}
+
+void Reclaimer::Retire(std::vector<PNode> nodes) {
+  if (!nodes.empty()) {
+    push(Job{nullptr, std::move(nodes)});
+  }
+}
+
+void Reclaimer::push(Job job) {
+  std::lock_guard lock{mutex_};
+  if (abandoned_) {
+    return;
+  }
+  if (!worker_.joinable()) {
+    worker_ = std::thread{&Reclaimer::run, this};
+  }
+  jobs_.push_back(std::move(job));
+  wake_.notify_one();
+}
+
+void Reclaimer::Flush() {
+  std::unique_lock lock{mutex_};
+  idle_.wait(lock, [this] { return (jobs_.empty() && !busy_) || abandoned_; });
+}
+
+void Reclaimer::Abandon() {
+  std::lock_guard lock{mutex_};
+  abandoned_ = true;
+  jobs_.clear();
+  wake_.notify_one();
+  idle_.notify_all();
+}
+
+Reclaimer::~Reclaimer() {
+  {
+    std::lock_guard lock{mutex_};
+    stop_ = true;
+    wake_.notify_one();
+  }
+  if (worker_.joinable()) {
+    worker_.join();
+  }
+}
+
+// без Abandon поток перед остановкой дочищает очередь
+void Reclaimer::run() {
+  std::unique_lock lock{mutex_};
+  while (true) {
+    wake_.wait(lock, [this] { return stop_ || abandoned_ || !jobs_.empty(); });
+    if (abandoned_ || jobs_.empty()) {
+      break;
+    }
+    auto job = std::move(jobs_.front());
+    jobs_.pop_front();
+    busy_ = true;
+    lock.unlock();
+    step(&job, kChunk);
+    lock.lock();
+    busy_ = false;
+    if (!job.Done() && !abandoned_) {
+      jobs_.push_back(std::move(job));
+    }
+    if (jobs_.empty()) {
+      idle_.notify_all();
+    }
+  }
+  idle_.notify_all();
+}
+
+// дерево разбирается поворотами: пока у корня есть левый сын, поворачиваю
+// вправо, а корень без левого сына освобождаю и иду в правого. Каждая
+// вершина поворачивается не больше одного раза, так что это O(n) без стека
+void Reclaimer::step(Job *job, size_t budget) {
+  for (; job->next < job->nodes.size() && budget > 0; --budget) {
+    delete job->nodes[job->next++];
+  }
+  auto v = job->root;
+  while (v && budget > 0) {
+    if (auto l = v->left) {
+      v->left = l->right;
+      l->right = v;
+      v = l;
+    } else {
+      auto next = v->right;
+      delete v;
+      v = next;
+      --budget;
+    }
+  }
+  job->root = v;
+}
+
+} // namespace DSViz
@@ -0,0 +1,73 @@
+#ifndef RECLAIMER_H
+#define RECLAIMER_H
+#include "Common/node.h"
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace DSViz {
+
+// освобождение вершин в фоновом потоке. Раньше удаленное дерево рекурсивно
+// освобождалось прямо в потоке модели: дерево на миллионы вершин подвешивало
+// окно, а бамбук (после вставки ключей по возрастанию) переполнял стек. Теперь
+// Trees и Journal только отдают сюда корень или список вершин за O(1), а поток
+// освобождает их без рекурсии порциями по kChunk вершин, переходя между
+// порциями к следующему заданию.
+//
+// отдавать можно только то, до чего модель уже не дотянется. При выходе
+// из программы освобождать память по вершине незачем: после Abandon все
+// отданное и еще не освобожденное просто бросается
+class Reclaimer {
+  using PNode = Node<int> *;
+
+public:
+  static Reclaimer &Instance();
+
+  // все дерево root по ссылкам left/right
+  void RetireTree(PNode root);
+  // отдельные вершины, nullptr пропускаются
+  void Retire(std::vector<PNode> nodes);
+
+  // ждет, пока все отданное будет освобождено
+  void Flush();
+  // больше ничего не освобождать, память при выходе вернет система
+  void Abandon();
+
+  ~Reclaimer();
+
+  static constexpr const size_t kChunk = size_t{1} << 14;
+
+private:
+  Reclaimer() = default;
+
+  struct Job {
+    // оставшаяся часть дерева
+    PNode root = {};
+    std::vector<PNode> nodes = {};
+    size_t next = {};
+
+    bool Done() const;
+  };
+
+  void push(Job job);
+  void run();
+  // освобождает не больше budget вершин задания
+  static void step(Job *job, size_t budget);
+
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  std::condition_variable idle_;
+  std::deque<Job> jobs_;
+  // поток держит задание, которого уже нет в jobs_
+  bool busy_ = {};
+  bool stop_ = {};
+  bool abandoned_ = {};
+  // запускается при первом задании
+  std::thread worker_;
+};
+
+} // namespace DSViz
+#endif // RECLAIMER_H
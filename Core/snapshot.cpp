@@ -0,0 +1,139 @@
+#include "Core/snapshot.h"
+#include "Core/view.h"
+#include <algorithm>
+#include <cmath>
+
+namespace DSViz {
+
+namespace {
+
+bool IsSubtreeState(State state) {
+  return state == State::a_subtree || state == State::b_subtree ||
+         state == State::c_subtree || state == State::d_subtree;
+}
+
+} // namespace
+
+Snapshot::Snapshot(PVNode root, MsgCode code, const detail::Overlay *overlay,
+                   const detail::HeatClock *heat)
+    : code_{code} {
+  if (!root) {
+    return;
+  }
+  std::vector<double> heats;
+  Add(root, -1, State::regular, overlay ? overlay->Collect() : Marks{}, heat,
+      heat ? &heats : nullptr);
+  if (heats.empty()) {
+    return;
+  }
+  int last = detail::Palette::kHeatLevels - 1;
+  double top = std::log1p(*std::max_element(heats.begin(), heats.end()));
+  for (size_t i = 0; i < vertices_.size(); ++i) {
+    double t = top > 0 ? std::log1p(heats[i]) / top : 0;
+    vertices_[i].heat = static_cast<int>(std::lround(t * last));
+  }
+}
+
+// повторяет то, что делает View::Draw: hide_this не рисуется вовсе, у
+// split_left/split_right не рисуется ребро в отрезанную сторону, а цвет
+// поддеревьев A, B, C, D наследуется всеми их вершинами
+void Snapshot::Add(PVNode vnode, int par, State inherited, const Marks &marks,
+                   const detail::HeatClock *heat, std::vector<double> *heats) {
+  auto it = marks.find(vnode->node);
+  State state = it != marks.end() ? it->second : State::regular;
+  if (IsSubtreeState(inherited)) {
+    state = inherited;
+  }
+  int cur = par;
+  if (state != State::hide_this) {
+    vertices_.push_back({static_cast<double>(vnode->x),
+                         static_cast<double>(vnode->y), vnode->node->value,
+                         state, par});
+    cur = static_cast<int>(vertices_.size()) - 1;
+    if (heats) {
+      heats->push_back(heat->Get(vnode->node));
+    }
+  }
+  if (vnode->left) {
+    Add(vnode->left,
+        (state == State::split_left || state == State::hide_this) ? -1 : cur,
+        state, marks, heat, heats);
+  }
+  if (vnode->right) {
+    Add(vnode->right,
+        (state == State::split_right || state == State::hide_this) ? -1 : cur,
+        state, marks, heat, heats);
+  }
+}
+
+QRectF Snapshot::Bounds() const {
+  if (vertices_.empty()) {
+    return {};
+  }
+  double r = detail::ReadyTree::kRadius;
+  double x_min = vertices_.front().x, x_max = x_min;
+  double y_min = vertices_.front().y, y_max = y_min;
+  for (auto &vertex : vertices_) {
+    x_min = std::min(x_min, vertex.x);
+    x_max = std::max(x_max, vertex.x);
+    y_min = std::min(y_min, vertex.y);
+    y_max = std::max(y_max, vertex.y);
+  }
+  return QRectF{QPointF{x_min - r, y_min - r}, QPointF{x_max + r, y_max + r}};
+}
+
+bool Snapshot::Empty() const { return vertices_.empty(); }
+
+const std::vector<Snapshot::Vertex> &Snapshot::Vertices() const {
+  return vertices_;
+}
+
+void Snapshot::Render(QPainter *painter, const QRectF &target) const {
+  using Palette = detail::Palette;
+  using Text = detail::Text;
+
+  painter->fillRect(target, Qt::white);
+  painter->setRenderHint(QPainter::Antialiasing);
+
+  QRectF text_rect = target.adjusted(kMargin / 2, kMargin / 4, -kMargin / 2, 0);
+  painter->drawText(text_rect, Qt::AlignLeft | Qt::AlignTop,
+                    QString::fromStdString(Text::GetMsg(code_)));
+  if (vertices_.empty()) {
+    return;
+  }
+
+  QRectF bounds = Bounds();
+  QRectF area = target.adjusted(kMargin, kMargin, -kMargin, -kMargin);
+  double scale = std::min(area.width() / std::max(bounds.width(), 1.0),
+                          area.height() / std::max(bounds.height(), 1.0));
+  auto map = [&](double x, double y) {
+    return QPointF{area.center().x() + (x - bounds.center().x()) * scale,
+                   area.center().y() - (y - bounds.center().y()) * scale};
+  };
+
+  painter->setPen(QPen{Qt::black, 1.0});
+  for (auto &vertex : vertices_) {
+    if (vertex.par != -1) {
+      auto &par = vertices_[vertex.par];
+      painter->drawLine(map(vertex.x, vertex.y), map(par.x, par.y));
+    }
+  }
+
+  double r = detail::ReadyTree::kRadius * scale;
+  int font_sz = std::max(1, static_cast<int>(r));
+  auto &labels = detail::LabelCache::Instance();
+  for (auto &vertex : vertices_) {
+    QPointF center = map(vertex.x, vertex.y);
+    QRectF circle{center - QPointF{r, r}, center + QPointF{r, r}};
+    painter->setBrush(vertex.heat >= 0 ? Palette::HeatColor(vertex.heat)
+                                       : Palette::GetColor(vertex.state));
+    painter->drawEllipse(circle);
+    if (font_sz >= View::kMinFontSz) {
+      auto label = labels.Get(vertex.value, font_sz, true);
+      painter->drawImage(center - QPointF(label.width(), label.height()) / 2,
+                         label);
+    }
+  }
+}
+
+} // namespace DSViz
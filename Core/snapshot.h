@@ -0,0 +1,61 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+#include "Common/node.h"
+#include "Core/heat.h"
+#include "Core/overlay.h"
+#include "Core/vnode.h"
+#include <QPainter>
+#include <QRectF>
+#include <unordered_map>
+#include <vector>
+
+namespace DSViz {
+
+// независимая от модели копия одного кадра: координаты уже разложенного
+// дерева, значения и состояния вершин. Модель меняет вершины на месте, так что
+// для отрисовки вне потока модели кадр нужно скопировать целиком
+class Snapshot {
+  using PVNode = VNode<int> *;
+  using Marks = std::unordered_map<const Node<int> *, State>;
+
+public:
+  struct Vertex {
+    double x, y;
+    int value;
+    State state;
+    // индекс родителя в vertices_ (-1, если ребра к родителю рисовать не надо)
+    int par;
+    // уровень тепловой карты (см. Palette::HeatColor), -1 - цвет по state
+    int heat = -1;
+  };
+
+  Snapshot() = default;
+  // состояния вершин берутся из overlay кадра, без него все вершины regular.
+  // С heat вершины красятся по весу из HeatClock в логарифмической шкале от
+  // нуля до самой горячей вершины кадра
+  Snapshot(PVNode root, MsgCode code,
+           const detail::Overlay *overlay = nullptr,
+           const detail::HeatClock *heat = nullptr);
+
+  QRectF Bounds() const;
+  bool Empty() const;
+  // вершины в прямом порядке обхода (для плиток, см. TileCache)
+  const std::vector<Vertex> &Vertices() const;
+
+  // рисует кадр, вписывая его в target (ось y направлена вверх, как в qwt)
+  void Render(QPainter *painter, const QRectF &target) const;
+
+  static constexpr const int kPixelsPerUnit = 4;
+  static constexpr const int kMargin = 40;
+
+private:
+  // веса вершин в heats (если задано) в том же порядке, что и vertices_
+  void Add(PVNode vnode, int par, State inherited, const Marks &marks,
+           const detail::HeatClock *heat, std::vector<double> *heats);
+
+  std::vector<Vertex> vertices_;
+  MsgCode code_ = MsgCode::empty_msg;
+};
+
+} // namespace DSViz
+#endif // SNAPSHOT_H
@@ -0,0 +1,240 @@
+#include "Core/tiles.h"
+#include "Core/view.h"
+#include <QtConcurrent>
+#include <cmath>
+
+namespace DSViz {
+
+namespace detail {
+
+bool TileCache::Look::operator==(const Look &other) const {
+  return radius == other.radius && font_sz == other.font_sz &&
+         colored == other.colored;
+}
+
+bool TileCache::same_scale(double a, double b) {
+  // на полотне в миллион пикселей 1e-9 - меньше тысячной пикселя
+  return std::abs(a - b) <= 1e-9 * std::abs(b);
+}
+
+void TileCache::SetLook(const Look &look) {
+  if (look == look_) {
+    return;
+  }
+  look_ = look;
+  pixmaps_.clear();
+  dirty_ = true;
+}
+
+void TileCache::SetSnapshot(Snapshot snapshot) {
+  snapshot_ = std::move(snapshot);
+  dirty_ = true;
+}
+
+void TileCache::Draw(QPainter *painter, const QwtScaleMap &x_map,
+                     const QwtScaleMap &y_map, const QRectF &canvas) {
+  double x_scale = (x_map.p2() - x_map.p1()) / (x_map.s2() - x_map.s1());
+  double y_scale = (y_map.p2() - y_map.p1()) / (y_map.s2() - y_map.s1());
+  if (!same_scale(x_scale, x_scale_) || !same_scale(y_scale, y_scale_)) {
+    // зум или новый размер окна: вся сетка другая
+    x_scale_ = x_scale;
+    y_scale_ = y_scale;
+    pixmaps_.clear();
+    dirty_ = true;
+  }
+  if (dirty_) {
+    index();
+  }
+
+  // начало координат раскладки округляю один раз, тогда соседние плитки
+  // встают друг к другу без щелей
+  double x0 = std::round(x_map.transform(0));
+  double y0 = std::round(y_map.transform(0));
+  int tx0 = std::floor((canvas.left() - x0) / kTileSize);
+  int tx1 = std::floor((canvas.right() - x0) / kTileSize);
+  int ty0 = std::floor((canvas.top() - y0) / kTileSize);
+  int ty1 = std::floor((canvas.bottom() - y0) / kTileSize);
+
+  struct Job {
+    int tx, ty;
+    const Tile *tile;
+    QImage image;
+  };
+  std::vector<quint64> visible;
+  std::vector<Job> jobs;
+  for (int ty = ty0; ty <= ty1; ++ty) {
+    for (int tx = tx0; tx <= tx1; ++tx) {
+      auto it = content_.find(key(tx, ty));
+      if (it == content_.end()) {
+        continue;
+      }
+      visible.push_back(it->first);
+      if (pixmaps_.find(it->first) == pixmaps_.end()) {
+        jobs.push_back(Job{tx, ty, &it->second, {}});
+      }
+    }
+  }
+
+  if (!jobs.empty()) {
+    QtConcurrent::blockingMap(jobs, [this](Job &job) {
+      job.image = render(job.tx, job.ty, *job.tile);
+    });
+    if (pixmaps_.size() + jobs.size() > kMaxTiles) {
+      std::unordered_map<quint64, QPixmap> kept;
+      for (auto k : visible) {
+        auto it = pixmaps_.find(k);
+        if (it != pixmaps_.end()) {
+          kept.emplace(k, std::move(it->second));
+        }
+      }
+      pixmaps_ = std::move(kept);
+    }
+    // QPixmap можно создавать только в потоке GUI
+    for (auto &job : jobs) {
+      pixmaps_[key(job.tx, job.ty)] = QPixmap::fromImage(std::move(job.image));
+    }
+  }
+
+  for (int ty = ty0; ty <= ty1; ++ty) {
+    for (int tx = tx0; tx <= tx1; ++tx) {
+      auto it = pixmaps_.find(key(tx, ty));
+      if (it != pixmaps_.end()) {
+        painter->drawPixmap(
+            QPointF{x0 + tx * kTileSize, y0 + ty * kTileSize}, it->second);
+      }
+    }
+  }
+}
+
+quint64 TileCache::key(int tx, int ty) {
+  return (static_cast<quint64>(static_cast<quint32>(tx)) << 32) |
+         static_cast<quint32>(ty);
+}
+
+// splitmix64
+quint64 TileCache::mix(quint64 x) {
+  x += 0x9e3779b97f4a7c15ULL;
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+  return x ^ (x >> 31);
+}
+
+void TileCache::index() {
+  dirty_ = false;
+  std::unordered_map<quint64, Tile> content;
+  if (x_scale_ == 0 || y_scale_ == 0) {
+    content_.clear();
+    pixmaps_.clear();
+    return;
+  }
+
+  auto &vertices = snapshot_.Vertices();
+  double r = look_.radius;
+  auto position = [](const Snapshot::Vertex &vertex) {
+    return (static_cast<quint64>(static_cast<quint32>(
+                static_cast<qint32>(vertex.x)))
+            << 32) |
+           static_cast<quint32>(static_cast<qint32>(vertex.y));
+  };
+  auto tile_of = [](double pixel) {
+    return static_cast<int>(std::floor(pixel / kTileSize));
+  };
+  for (int i = 0; i < static_cast<int>(vertices.size()); ++i) {
+    auto &vertex = vertices[i];
+    double x = vertex.x * x_scale_, y = vertex.y * y_scale_;
+    // подпись может быть шире кружка, под нее оставляю 2r в каждую сторону
+    quint64 hash = mix(mix(position(vertex)) ^
+                       static_cast<quint32>(vertex.value));
+    hash = mix(hash ^ (static_cast<quint64>(vertex.state) << 1) ^
+               (static_cast<quint64>(vertex.heat + 1) << 8));
+    add(tile_of(x - 2 * r), tile_of(x + 2 * r), tile_of(y - r),
+        tile_of(y + r), hash, i, false, &content);
+
+    if (vertex.par != -1) {
+      auto &par = vertices[vertex.par];
+      double px = par.x * x_scale_, py = par.y * y_scale_;
+      quint64 edge = mix(mix(position(vertex)) + position(par));
+      add(tile_of(std::min(x, px)), tile_of(std::max(x, px)),
+          tile_of(std::min(y, py)), tile_of(std::max(y, py)), edge, i, true,
+          &content);
+    }
+  }
+
+  // выбрасываю только те плитки, содержимое которых поменялось
+  for (auto it = pixmaps_.begin(); it != pixmaps_.end();) {
+    auto cur = content.find(it->first);
+    auto old = content_.find(it->first);
+    if (cur == content.end() || old == content_.end() ||
+        cur->second.signature != old->second.signature) {
+      it = pixmaps_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+  content_ = std::move(content);
+}
+
+void TileCache::add(int tx0, int tx1, int ty0, int ty1, quint64 hash, int item,
+                    bool edge, std::unordered_map<quint64, Tile> *tiles) const {
+  for (int ty = ty0; ty <= ty1; ++ty) {
+    for (int tx = tx0; tx <= tx1; ++tx) {
+      auto &tile = (*tiles)[key(tx, ty)];
+      // сумма не зависит от порядка обхода, а он после поворотов другой
+      tile.signature += hash;
+      (edge ? tile.edges : tile.vertices).push_back(item);
+    }
+  }
+}
+
+QImage TileCache::render(int tx, int ty, const Tile &tile) const {
+  QImage image{kTileSize, kTileSize, QImage::Format_ARGB32_Premultiplied};
+  image.fill(Qt::transparent);
+  QPainter painter{&image};
+  painter.setRenderHint(QPainter::Antialiasing);
+  painter.translate(-tx * kTileSize, -ty * kTileSize);
+
+  auto &vertices = snapshot_.Vertices();
+  auto map = [this](const Snapshot::Vertex &vertex) {
+    return QPointF{vertex.x * x_scale_, vertex.y * y_scale_};
+  };
+  painter.setPen(QPen{Qt::black, 0});
+  for (int i : tile.edges) {
+    painter.drawLine(map(vertices[i]), map(vertices[vertices[i].par]));
+  }
+
+  double r = look_.radius;
+  auto &labels = LabelCache::Instance();
+  for (int i : tile.vertices) {
+    auto &vertex = vertices[i];
+    QPointF center = map(vertex);
+    // тепловая карта видна и без анимации
+    if (vertex.heat >= 0) {
+      painter.setBrush(Palette::HeatColor(vertex.heat));
+    } else {
+      painter.setBrush(look_.colored ? Palette::GetColor(vertex.state)
+                                     : Palette::kDefaultColor);
+    }
+    painter.drawEllipse(center, r, r);
+    if (look_.font_sz > 0) {
+      auto label = labels.Get(vertex.value, look_.font_sz);
+      painter.drawImage(center - QPointF(label.width(), label.height()) / 2,
+                        label);
+    }
+  }
+  painter.end();
+  return image;
+}
+
+TileLayer::TileLayer(TileCache *cache) : cache_{cache} {
+  setZ(20);
+  setItemAttribute(QwtPlotItem::Legend, false);
+}
+
+void TileLayer::draw(QPainter *painter, const QwtScaleMap &x_map,
+                     const QwtScaleMap &y_map, const QRectF &canvas) const {
+  cache_->Draw(painter, x_map, y_map, canvas);
+}
+
+} // namespace detail
+
+} // namespace DSViz
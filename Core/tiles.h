@@ -0,0 +1,93 @@
+#ifndef TILES_H
+#define TILES_H
+#include "Core/snapshot.h"
+#include <QImage>
+#include <QPixmap>
+#include <qwt_plot_item.h>
+#include <qwt_scale_map.h>
+#include <unordered_map>
+#include <vector>
+
+namespace DSViz {
+
+namespace detail {
+
+// растровый кэш полотна. Полотно режется на плитки kTileSize x kTileSize
+// пикселей, выровненные по сетке в координатах раскладки, так что при
+// панорамировании плитки только сдвигаются. Для каждой плитки я помню, какие
+// вершины и ребра в нее попадают, и подпись - хэш всего этого (координаты,
+// значение, состояние, уровень тепловой карты). Новый кадр выбрасывает только
+// плитки с изменившейся подписью, а недостающие видимые плитки растеризуются
+// параллельно
+class TileCache {
+public:
+  // от чего еще зависит растр: радиус вершины в пикселях, размер шрифта
+  // подписи (0 - без подписей) и раскрашивать ли вершины по состоянию
+  struct Look {
+    double radius = 0;
+    int font_sz = 0;
+    bool colored = true;
+
+    bool operator==(const Look &other) const;
+  };
+
+  void SetLook(const Look &look);
+  void SetSnapshot(Snapshot snapshot);
+
+  // рисует видимую часть полотна canvas, карты переводят координаты
+  // раскладки в пиксели
+  void Draw(QPainter *painter, const QwtScaleMap &x_map,
+            const QwtScaleMap &y_map, const QRectF &canvas);
+
+  static constexpr const int kTileSize = 256;
+  // 256 плиток по 256x256 ARGB - 64 МБ
+  static constexpr const int kMaxTiles = 256;
+
+private:
+  struct Tile {
+    quint64 signature = 0;
+    // индексы в Snapshot::Vertices(); у ребра - индекс нижнего конца
+    std::vector<int> vertices;
+    std::vector<int> edges;
+  };
+
+  // масштаб пересчитывается из карт qwt заново на каждый кадр, и при сдвиге
+  // (s2 + d) - (s1 + d) отличается от s2 - s1 на несколько ULP. Сравниваю с
+  // допуском, иначе каждый шаг панорамирования выбрасывал бы все плитки
+  static bool same_scale(double a, double b);
+  static quint64 key(int tx, int ty);
+  static quint64 mix(quint64 x);
+  // пересчет содержимого и подписей плиток, плитки с другой подписью
+  // выбрасываются
+  void index();
+  void add(int tx0, int tx1, int ty0, int ty1, quint64 hash, int item,
+           bool edge, std::unordered_map<quint64, Tile> *tiles) const;
+  QImage render(int tx, int ty, const Tile &tile) const;
+
+  Snapshot snapshot_;
+  Look look_;
+  // пикселей на единицу раскладки, по y со знаком (ось y в qwt вверх)
+  double x_scale_ = 0;
+  double y_scale_ = 0;
+  // снимок или внешний вид поменялись, а содержимое плиток еще не пересчитано
+  bool dirty_ = false;
+  std::unordered_map<quint64, Tile> content_;
+  std::unordered_map<quint64, QPixmap> pixmaps_;
+};
+
+// элемент qwt, который рисует полотно из TileCache
+class TileLayer : public QwtPlotItem {
+public:
+  explicit TileLayer(TileCache *cache);
+
+  void draw(QPainter *painter, const QwtScaleMap &x_map,
+            const QwtScaleMap &y_map, const QRectF &canvas) const override;
+
+private:
+  TileCache *cache_;
+};
+
+} // namespace detail
+
+} // namespace DSViz
+#endif // TILES_H
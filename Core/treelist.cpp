@@ -0,0 +1,89 @@
+#include "Core/treelist.h"
+#include <algorithm>
+
+namespace DSViz {
+
+namespace detail {
+
+int TreeList::rowCount(const QModelIndex &parent) const {
+  return parent.isValid() ? 0 : static_cast<int>(ids_.size());
+}
+
+QVariant TreeList::data(const QModelIndex &index, int role) const {
+  if (!index.isValid() || index.row() >= rowCount()) {
+    return {};
+  }
+  if (role == Qt::DisplayRole || role == Qt::EditRole) {
+    return QString::number(ids_[index.row()]);
+  }
+  return {};
+}
+
+void TreeList::Sync(const Trees *trees) {
+  if (trees == trees_ && trees->IdsVersion() == ids_version_) {
+    return;
+  }
+  trees_ = trees;
+  ids_version_ = trees->IdsVersion();
+  live_.clear();
+  for (int id = 0; id < trees->Capacity(); ++id) {
+    if (trees->Contains(id)) {
+      live_.push_back(id);
+    }
+  }
+
+  // оба списка отсортированы, так что иду по ним слиянием: подряд идущие
+  // пропавшие id удаляются одним блоком строк, новые вставляются так же.
+  // Комбобокс при этом сам сдвигает свою текущую строку
+  int row = 0;
+  size_t j = 0;
+  while (row < rowCount() || j < live_.size()) {
+    bool left = row < rowCount(), right = j < live_.size();
+    if (left && (!right || ids_[row] < live_[j])) {
+      int last = row;
+      while (last + 1 < rowCount() && (!right || ids_[last + 1] < live_[j])) {
+        ++last;
+      }
+      remove_rows(row, last);
+    } else if (right && (!left || live_[j] < ids_[row])) {
+      size_t end = j;
+      while (end < live_.size() && (!left || live_[end] < ids_[row])) {
+        ++end;
+      }
+      insert_rows(row, live_.data() + j, live_.data() + end);
+      row += static_cast<int>(end - j);
+      j = end;
+    } else {
+      ++row;
+      ++j;
+    }
+  }
+}
+
+int TreeList::IdAt(int row) const {
+  return row >= 0 && row < rowCount() ? ids_[row] : -1;
+}
+
+int TreeList::RowOf(int id) const {
+  auto it = std::lower_bound(ids_.begin(), ids_.end(), id);
+  if (it == ids_.end() || *it != id) {
+    return -1;
+  }
+  return static_cast<int>(it - ids_.begin());
+}
+
+void TreeList::remove_rows(int first, int last) {
+  beginRemoveRows(QModelIndex{}, first, last);
+  ids_.erase(ids_.begin() + first, ids_.begin() + last + 1);
+  endRemoveRows();
+}
+
+void TreeList::insert_rows(int row, const int *first, const int *last) {
+  beginInsertRows(QModelIndex{}, row, row + static_cast<int>(last - first) - 1);
+  ids_.insert(ids_.begin() + row, first, last);
+  endInsertRows();
+}
+
+} // namespace detail
+
+} // namespace DSViz
@@ -0,0 +1,43 @@
+#ifndef TREELIST_H
+#define TREELIST_H
+#include "Core/trees.h"
+#include <QAbstractListModel>
+#include <cstdint>
+#include <vector>
+
+namespace DSViz {
+
+namespace detail {
+
+// список живых id деревьев для комбобоксов. Раньше на каждом кадре все три
+// комбобокса очищались и заполнялись строками заново, а после тысяч split это
+// стоило дороже самой операции. Теперь три комбобокса смотрят в одну модель,
+// а она меняется только когда меняется набор id (Trees::IdsVersion), и то
+// только вставкой и удалением нужных строк. id в списке по возрастанию, так
+// что строка по id ищется двоичным поиском
+class TreeList : public QAbstractListModel {
+public:
+  int rowCount(const QModelIndex &parent = QModelIndex{}) const override;
+  QVariant data(const QModelIndex &index,
+                int role = Qt::DisplayRole) const override;
+
+  void Sync(const Trees *trees);
+
+  // -1, если такой строки / такого id нет
+  int IdAt(int row) const;
+  int RowOf(int id) const;
+
+private:
+  void remove_rows(int first, int last);
+  void insert_rows(int row, const int *first, const int *last);
+
+  std::vector<int> ids_;
+  std::vector<int> live_;
+  const Trees *trees_ = {};
+  uint64_t ids_version_ = {};
+};
+
+} // namespace detail
+
+} // namespace DSViz
+#endif // TREELIST_H
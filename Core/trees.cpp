@@ -0,0 +1,163 @@
+#include "trees.h"
+#include "Core/journal.h"
+#include "Core/reclaimer.h"
+#include <algorithm>
+
+namespace DSViz {
+
+namespace detail {
+
+Trees::~Trees() {
+  for (int id = 0; id < Capacity(); ++id) {
+    if (alive_[id]) {
+      Reclaimer::Instance().RetireTree(roots_[id]);
+    }
+  }
+}
+
+int Trees::Insert(PNode node) {
+  int id;
+  if (!free_ids_.empty()) {
+    id = free_ids_.back();
+    free_ids_.pop_back();
+  } else {
+    id = Capacity();
+    roots_.push_back(nullptr);
+    alive_.push_back(false);
+    modes_.push_back(Mode::values);
+    versions_.push_back(0);
+  }
+  touch(id);
+  ++ids_version_;
+  alive_[id] = true;
+  modes_[id] = Mode::values;
+  ++size_;
+  Set(id, node);
+  return id;
+}
+
+void Trees::DeleteTree(int id) {
+  if (Contains(id)) {
+    if (journal_) {
+      journal_->ReleaseTree(roots_[id]);
+    } else {
+      Reclaimer::Instance().RetireTree(roots_[id]);
+    }
+    DiscardTree(id);
+  }
+}
+
+void Trees::DiscardTree(int id) {
+  if (Contains(id)) {
+    touch(id);
+    roots_[id] = nullptr;
+    alive_[id] = false;
+    ++ids_version_;
+    free_ids_.push_back(id);
+    --size_;
+  }
+}
+
+size_t Trees::Size() const { return size_; }
+
+int Trees::NextId() const {
+  if (!free_ids_.empty()) {
+    return free_ids_.back();
+  }
+  return Capacity();
+}
+
+int Trees::Capacity() const { return static_cast<int>(roots_.size()); }
+
+bool Trees::Contains(int id) const {
+  return id >= 0 && id < Capacity() && alive_[id];
+}
+
+int Trees::First() const {
+  for (int id = 0; id < Capacity(); ++id) {
+    if (alive_[id]) {
+      return id;
+    }
+  }
+  return -1;
+}
+
+Trees::PNode Trees::operator[](int id) const { return roots_[id]; }
+
+void Trees::Set(int id, PNode root) {
+  touch(id);
+  roots_[id] = root;
+  if (root) {
+    root->tree_id = id;
+  }
+}
+
+int Trees::OwnerOf(PNode root) const {
+  if (!root) {
+    return -1;
+  }
+  // tree_id у бывшего корня мог остаться старым, поэтому проверяю, что
+  // слот действительно указывает на эту вершину
+  int id = root->tree_id;
+  if (Contains(id) && roots_[id] == root) {
+    return id;
+  }
+  return -1;
+}
+
+Trees::Mode Trees::ModeOf(int id) const {
+  return Contains(id) ? modes_[id] : Mode::values;
+}
+
+void Trees::SetMode(int id, Mode mode) {
+  touch(id);
+  modes_[id] = mode;
+}
+
+uint64_t Trees::Version(int id) const {
+  return id >= 0 && id < Capacity() ? versions_[id] : 0;
+}
+
+void Trees::Bump(int id) {
+  if (id >= 0 && id < Capacity()) {
+    versions_[id] = ++version_;
+  }
+}
+
+uint64_t Trees::IdsVersion() const { return ids_version_; }
+
+void Trees::SetJournal(Journal *journal) { journal_ = journal; }
+
+void Trees::Restore(int id, PNode root, bool alive, Mode mode) {
+  if (alive && !alive_[id]) {
+    auto it = std::find(free_ids_.begin(), free_ids_.end(), id);
+    if (it != free_ids_.end()) {
+      free_ids_.erase(it);
+    }
+    ++size_;
+  } else if (!alive && alive_[id]) {
+    free_ids_.push_back(id);
+    --size_;
+  }
+  Bump(id);
+  if (alive != alive_[id]) {
+    ++ids_version_;
+  }
+  alive_[id] = alive;
+  modes_[id] = mode;
+  roots_[id] = root;
+  if (root) {
+    root->tree_id = id;
+  }
+}
+
+void Trees::touch(int id) {
+  Bump(id);
+  if (journal_) {
+    journal_->TouchSlot(id, roots_[id], alive_[id], modes_[id]);
+  }
+}
+
+} // namespace detail
+
+} // namespace DSViz
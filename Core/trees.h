@@ -0,0 +1,95 @@
+#ifndef TREES_H
+#define TREES_H
+#include "Common/node.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace DSViz {
+
+namespace detail {
+
+class Journal;
+
+// реестр деревьев: id - это просто индекс в векторе слотов. Удаленные id
+// складываются в free list и переиспользуются при следующем Insert, так что
+// слоты остаются плотными даже после тысяч split/delete.
+//
+// кроме того корень каждого дерева помнит свой id (Node::tree_id), поэтому
+// узнать по корню, какому дереву он принадлежит, можно за O(1)
+class Trees {
+  using PNode = Node<int> *;
+
+public:
+  Trees() = default;
+  ~Trees();
+
+  Trees(const Trees &) = delete;
+  Trees &operator=(const Trees &) = delete;
+  Trees(Trees &&) = delete;
+  Trees &operator=(Trees &&) = delete;
+
+  int Insert(PNode node);
+
+  void DeleteTree(int id);
+  void DiscardTree(int id);
+
+  size_t Size() const;
+
+  // id, который получит следующее вставленное дерево
+  int NextId() const;
+  // верхняя граница для id (все живые id лежат в [0, Capacity()))
+  int Capacity() const;
+  bool Contains(int id) const;
+  int First() const;
+
+  PNode operator[](int id) const;
+  void Set(int id, PNode root);
+
+  // id дерева, корнем которого является root, либо -1
+  int OwnerOf(PNode root) const;
+
+  // values - обычное дерево поиска по значению. sequence - ключом служит
+  // позиция (размер левого поддерева), а не значение. forest - слот, через
+  // который показывается лес link-cut (см. Model::Link): корень слота - это
+  // splay дерево последнего пройденного предпочтительного пути, вершинами
+  // леса владеет модель. Новое дерево всегда values
+  enum class Mode { values, sequence, forest };
+
+  Mode ModeOf(int id) const;
+  void SetMode(int id, Mode mode);
+
+  // версия дерева: меняется при каждом изменении слота, а модель еще и при
+  // каждом кадре операции над деревом (повороты внутри дерева слот не
+  // трогают). Счетчик общий на все слоты, так что пара (id, версия) не
+  // повторяется, даже если id достался новому дереву
+  uint64_t Version(int id) const;
+  void Bump(int id);
+  // меняется, только когда дерево создается или удаляется, т.е. когда
+  // меняется набор живых id
+  uint64_t IdsVersion() const;
+
+  // если журнал задан, все изменения слотов записываются в него, а DeleteTree
+  // отдает дерево журналу вместо того, чтобы сразу его удалить
+  void SetJournal(Journal *journal);
+  // возвращает слот в сохраненное журналом состояние, в журнал не пишет
+  void Restore(int id, PNode root, bool alive, Mode mode);
+
+private:
+  void touch(int id);
+
+  std::vector<PNode> roots_;
+  std::vector<bool> alive_;
+  std::vector<Mode> modes_;
+  std::vector<int> free_ids_;
+  std::vector<uint64_t> versions_;
+  uint64_t version_ = {};
+  uint64_t ids_version_ = {};
+  size_t size_ = {};
+  Journal *journal_ = {};
+};
+
+} // namespace detail
+
+} // namespace DSViz
+#endif // TREES_H
@@ -1,8 +1,15 @@
 #include "Core/view.h"
 #include "ui_mainwindow.h"
+#include <QCompleter>
+#include <QFileDialog>
+#include <QFutureWatcher>
 #include <QMessageBox>
 #include <QMouseEvent>
-#include <qwt_plot_curve.h>
+#include <QPainter>
+#include <QSignalBlocker>
+#include <QtConcurrent>
+#include <algorithm>
+#include <cmath>
 #include <qwt_plot_legenditem.h>
 #include <qwt_plot_marker.h>
 #include <qwt_text.h>
@@ -18,6 +25,12 @@ QColor Palette::GetColor(State state) {
   return kDefaultColor;
 }
 
+QColor Palette::HeatColor(int level) {
+  double t = static_cast<double>(std::clamp(level, 0, kHeatLevels - 1)) /
+             (kHeatLevels - 1);
+  return QColor::fromHsv(static_cast<int>((1 - t) * 240), 200, 240);
+}
+
 std::string Text::GetMsg(MsgCode code) {
   if (StrMsg.find(code) != StrMsg.end()) {
     return StrMsg.at(code);
@@ -56,6 +69,137 @@ std::string Text::LegendByState(State state) {
   return str;
 }
 
+LabelCache &LabelCache::Instance() {
+  static LabelCache cache{View::kFont};
+  return cache;
+}
+
+LabelCache::LabelCache(const char *family) : family_{family} {}
+
+QImage LabelCache::Get(int value, int font_sz, bool pixels) {
+  auto key = std::make_tuple(value, font_sz, pixels);
+  {
+    std::lock_guard lock{mutex_};
+    auto it = cache_.find(key);
+    if (it != cache_.end()) {
+      return it->second;
+    }
+  }
+
+  // растеризую без блокировки: два потока могут нарисовать одну подпись
+  // дважды, зато остальные в это время не ждут
+  QFont font{family_};
+  if (pixels) {
+    font.setPixelSize(font_sz);
+  } else {
+    font.setPointSize(font_sz);
+  }
+  QString text = QString::number(value);
+  QFontMetrics metrics{font};
+  QImage image{std::max(1, metrics.horizontalAdvance(text)),
+               std::max(1, metrics.height()),
+               QImage::Format_ARGB32_Premultiplied};
+  image.fill(Qt::transparent);
+  QPainter painter{&image};
+  painter.setFont(font);
+  painter.drawText(image.rect(), Qt::AlignCenter, text);
+  painter.end();
+
+  std::lock_guard lock{mutex_};
+  if (cache_.size() >= kMaxSize) {
+    cache_.clear();
+  }
+  return cache_.emplace(key, std::move(image)).first->second;
+}
+
+LabeledSymbol::LabeledSymbol(Style style, QImage label)
+    : QwtSymbol{style}, label_{std::move(label)} {}
+
+void LabeledSymbol::renderSymbols(QPainter *painter, const QPointF *points,
+                                  int num_points) const {
+  QwtSymbol::renderSymbols(painter, points, num_points);
+  if (label_.isNull()) {
+    return;
+  }
+  for (int i = 0; i < num_points; ++i) {
+    QPointF corner = points[i] - QPointF(label_.width(), label_.height()) / 2;
+    painter->drawImage(corner, label_);
+  }
+}
+
+std::string Text::BatchSummary(const std::vector<MsgCode> &results) {
+  int errors = 0;
+  for (auto code : results) {
+    if (code == MsgCode::wrong_id || code == MsgCode::insert_err ||
+        code == MsgCode::remove_err || code == MsgCode::merge_err ||
+        code == MsgCode::split_err || code == MsgCode::merge_equal ||
+        code == MsgCode::merge_empty || code == MsgCode::unsucc_del ||
+        code == MsgCode::mode_err || code == MsgCode::index_err ||
+        code == MsgCode::vertex_err || code == MsgCode::link_err ||
+        code == MsgCode::cut_err || code == MsgCode::range_err ||
+        code == MsgCode::empty_msg) {
+      ++errors;
+    }
+  }
+  return std::to_string(results.size()) + " queries, " +
+         std::to_string(results.size() - errors) + " succeeded, " +
+         std::to_string(errors) + " failed";
+}
+
+std::string Text::SplaySummary(const SplayStats &stats) {
+  return std::to_string(stats.finds) + " finds, " +
+         std::to_string(stats.rotations) + " rotations, " +
+         std::to_string(stats.saved) + " saved";
+}
+
+std::string Text::Answer(MsgCode code, const std::vector<int> &values) {
+  if ((code == MsgCode::forest_root || code == MsgCode::neighbour) &&
+      values.size() == 1) {
+    return GetMsg(code) + std::to_string(values[0]);
+  }
+  if (code == MsgCode::path_done && values.size() == 3) {
+    return GetMsg(code) + std::to_string(values[0]) + " vertices, min " +
+           std::to_string(values[1]) + ", max " + std::to_string(values[2]);
+  }
+  if (code == MsgCode::extract_done && values.size() == 2) {
+    return GetMsg(code) + std::to_string(values[0]) + " (" +
+           std::to_string(values[1]) + " keys)";
+  }
+  if (code == MsgCode::load_done && values.size() == 2) {
+    return GetMsg(code) + std::to_string(values[0]) + " (" +
+           std::to_string(values[1]) + " new)";
+  }
+  if (code == MsgCode::optimal_done && values.size() == 5) {
+    auto per_find = [](int hundredths) {
+      return std::to_string(hundredths / 100) + "." +
+             std::to_string(hundredths % 100 / 10) +
+             std::to_string(hundredths % 10);
+    };
+    return GetMsg(code) + std::to_string(values[0]) +
+           (values[1] ? " (Knuth, exact)" : " (Mehlhorn)") + ". " +
+           std::to_string(values[2]) + " finds, comparisons per find: splay " +
+           per_find(values[3]) + ", static " + per_find(values[4]);
+  }
+  if ((code == MsgCode::erase_done || code == MsgCode::trace_off) &&
+      values.size() == 1) {
+    return GetMsg(code) + std::to_string(values[0]);
+  }
+  return GetMsg(code);
+}
+
+HeatLegendItem::HeatLegendItem(const QString &title, QColor color)
+    : QwtPlotItem{QwtText{title}}, color_{color} {
+  setItemAttribute(QwtPlotItem::Legend, true);
+  setLegendIconSize(QSize(View::kLegSz, View::kLegSz));
+}
+
+void HeatLegendItem::draw(QPainter *, const QwtScaleMap &, const QwtScaleMap &,
+                          const QRectF &) const {}
+
+QwtGraphic HeatLegendItem::legendIcon(int, const QSizeF &size) const {
+  return defaultIcon(color_, size);
+}
+
 CustomPanner::CustomPanner(QWidget *parent) : QwtPlotPanner(parent) {}
 
 // переопределяю eventFilter чтобы не было такого, что я двигаю qwt_plot
@@ -107,7 +251,7 @@ bool CustomPanner::eventFilter(QObject *object, QEvent *event) {
 
 // высунул вперед, т.к. компилятор должен смочь вывести тип в auto
 auto View::GetCallback() {
-  return [this](const MsgType &msg) { HandleMsg(msg.first, msg.second); };
+  return [this](const MsgType &msg) { HandleMsg(msg); };
 }
 
 View::View()
@@ -128,6 +272,8 @@ void View::SubscribeToUserInput(Observer<UserQuery> *controller_observer) {
 
 Observer<View::MsgType> *View::GetPortIn() { return &port_in_; }
 
+void View::OnRemote(bool running) { SetEnabledWidgets(!running); }
+
 void View::OnPanned(int dx, int dy) {
   x_ += dx;
   y_ += dy;
@@ -151,12 +297,53 @@ void View::OnButtonClick() {
   if (sender() == MW_->ui->mergeButton) {
     SetEnabledWidgets(false);
     merge_executing_ = true;
-    port_out_.Set(UserQuery{QueryType::merge, {left_tree_id_, right_tree_id_}});
+    Send(UserQuery{QueryType::merge, {left_tree_id_, right_tree_id_}});
     merge_executing_ = false;
     SetEnabledWidgets(true);
     main_tree_id_ = left_tree_id_;
-    int ind = MW_->ui->maintreeId->findText(QString::number(main_tree_id_));
-    MW_->ui->maintreeId->setCurrentIndex(ind);
+    MW_->ui->maintreeId->setCurrentIndex(tree_list_.RowOf(main_tree_id_));
+    return;
+  }
+
+  if (sender() == MW_->ui->workloadButton) {
+    RunWorkload();
+    return;
+  }
+
+  if (sender() == MW_->ui->policyButton) {
+    SetPolicy();
+    return;
+  }
+
+  // запись идет по текущему дереву, кнопка помнит только последнее нажатие
+  if (sender() == MW_->ui->traceButton) {
+    Send(UserQuery{QueryType::trace,
+                   {main_tree_id_, MW_->ui->traceButton->isChecked()}});
+    return;
+  }
+
+  if (sender() == MW_->ui->optimalButton) {
+    Send(UserQuery{QueryType::optimal, {main_tree_id_, 0}});
+    return;
+  }
+
+  if (sender() == MW_->ui->seqButton) {
+    RunSequence();
+    return;
+  }
+
+  if (sender() == MW_->ui->forestButton) {
+    RunForest();
+    return;
+  }
+
+  if (sender() == MW_->ui->rangeButton) {
+    RunRange();
+    return;
+  }
+
+  if (sender() == MW_->ui->importButton) {
+    RunImport();
     return;
   }
 
@@ -165,18 +352,24 @@ void View::OnButtonClick() {
   int ver = MW_->ui->vertexId->text().toInt(&ver_correct);
 
   if (sender() == MW_->ui->deltreeButton) {
-    port_out_.Set(UserQuery{QueryType::deltree, {id, 0}});
+    Send(UserQuery{QueryType::deltree, {id, 0}});
+
+  } else if (sender() == MW_->ui->undoButton) {
+    Send(UserQuery{QueryType::undo, {id, 0}});
+
+  } else if (sender() == MW_->ui->redoButton) {
+    Send(UserQuery{QueryType::redo, {id, 0}});
 
   } else if (ver_correct) {
     SetEnabledWidgets(false);
     if (sender() == MW_->ui->insertButton) {
-      port_out_.Set(UserQuery{QueryType::insert, {id, ver}});
+      Send(UserQuery{QueryType::insert, {id, ver}});
     } else if (sender() == MW_->ui->removeButton) {
-      port_out_.Set(UserQuery{QueryType::remove, {id, ver}});
+      Send(UserQuery{QueryType::remove, {id, ver}});
     } else if (sender() == MW_->ui->findButton) {
-      port_out_.Set(UserQuery{QueryType::find, {id, ver}});
+      Send(UserQuery{QueryType::find, {id, ver}});
     } else if (sender() == MW_->ui->splitButton) {
-      port_out_.Set(UserQuery{QueryType::split, {id, ver}});
+      Send(UserQuery{QueryType::split, {id, ver}});
     }
     SetEnabledWidgets(true);
   } else {
@@ -193,20 +386,46 @@ void View::OnZoom(double value) {
   panner_->moveCanvas(x_, y_);
 }
 
-void View::OnChoiceChange(QString num) {
-  main_tree_id_ = num.toInt();
+void View::OnChoiceChange(int row) {
+  if (tree_list_.IdAt(row) < 0) {
+    return;
+  }
+  main_tree_id_ = tree_list_.IdAt(row);
   Prepare();
   Draw();
 }
 
-void View::OnMergeChoiceChange(QString num) {
+void View::OnMergeChoiceChange(int row) {
+  if (tree_list_.IdAt(row) < 0) {
+    return;
+  }
   if (sender() == MW_->ui->lefttreeId) {
-    left_tree_id_ = num.toInt();
+    left_tree_id_ = tree_list_.IdAt(row);
   } else {
-    right_tree_id_ = num.toInt();
+    right_tree_id_ = tree_list_.IdAt(row);
   }
 }
 
+void View::OnLayoutChange(bool compact) {
+  layout_ = compact ? ReadyTree::Layout::tidy : ReadyTree::Layout::weight;
+  Prepare();
+  Draw();
+  panner_->moveCanvas(x_, y_);
+}
+
+void View::OnHeatChange(bool on) {
+  MW_->ui->hotKeys->setVisible(on);
+  // считать обращения модель начинает только теперь, кадр ответа
+  // перерисует дерево
+  Send(UserQuery{QueryType::heat_map, {main_tree_id_, on}});
+  panner_->moveCanvas(x_, y_);
+}
+
+void View::OnHeatDecay() {
+  Send(UserQuery{QueryType::heat,
+                 {main_tree_id_, MW_->ui->heatHalfLife->value()}});
+}
+
 void View::ConnectWidgets() {
   QObject::connect(MW_->ui->insertButton, SIGNAL(clicked()), this,
                    SLOT(OnButtonClick()));
@@ -220,10 +439,36 @@ void View::ConnectWidgets() {
                    SLOT(OnButtonClick()));
   QObject::connect(MW_->ui->deltreeButton, SIGNAL(clicked()), this,
                    SLOT(OnButtonClick()));
+  QObject::connect(MW_->ui->workloadButton, SIGNAL(clicked()), this,
+                   SLOT(OnButtonClick()));
+  QObject::connect(MW_->ui->policyButton, SIGNAL(clicked()), this,
+                   SLOT(OnButtonClick()));
+  QObject::connect(MW_->ui->seqButton, SIGNAL(clicked()), this,
+                   SLOT(OnButtonClick()));
+  QObject::connect(MW_->ui->forestButton, SIGNAL(clicked()), this,
+                   SLOT(OnButtonClick()));
+  QObject::connect(MW_->ui->rangeButton, SIGNAL(clicked()), this,
+                   SLOT(OnButtonClick()));
+  QObject::connect(MW_->ui->traceButton, SIGNAL(clicked()), this,
+                   SLOT(OnButtonClick()));
+  QObject::connect(MW_->ui->optimalButton, SIGNAL(clicked()), this,
+                   SLOT(OnButtonClick()));
+  QObject::connect(MW_->ui->importButton, SIGNAL(clicked()), this,
+                   SLOT(OnButtonClick()));
+  QObject::connect(MW_->ui->undoButton, SIGNAL(clicked()), this,
+                   SLOT(OnButtonClick()));
+  QObject::connect(MW_->ui->redoButton, SIGNAL(clicked()), this,
+                   SLOT(OnButtonClick()));
   QObject::connect(MW_->ui->qwt_slider, SIGNAL(sliderMoved(double)), this,
                    SLOT(OnZoom(double)));
   QObject::connect(MW_->ui->pauseButton, SIGNAL(clicked()), this,
                    SLOT(OnPauseOrStop()));
+  QObject::connect(MW_->ui->compactLayout, SIGNAL(toggled(bool)), this,
+                   SLOT(OnLayoutChange(bool)));
+  QObject::connect(MW_->ui->heatMap, SIGNAL(toggled(bool)), this,
+                   SLOT(OnHeatChange(bool)));
+  QObject::connect(MW_->ui->heatHalfLife, SIGNAL(editingFinished()), this,
+                   SLOT(OnHeatDecay()));
   ConnectComboBoxes();
   QObject::connect(panner_.get(), SIGNAL(panned(int, int)), this,
                    SLOT(OnPanned(int, int)));
@@ -238,83 +483,236 @@ void View::ConfigureWidgets() {
   MW_->ui->qwt_slider->setValue(kSliderBegin);
   MW_->ui->qwt_slider->setScale(kSliderLowerBound, kSliderUpperBound);
   panner_->setMouseButton(Qt::LeftButton);
+  MW_->ui->hotKeys->setVisible(false);
+  // id можно не только выбрать из списка, но и начать набирать: комплитер
+  // ищет по той же модели
+  for (auto box :
+       {MW_->ui->maintreeId, MW_->ui->lefttreeId, MW_->ui->righttreeId}) {
+    box->setModel(&tree_list_);
+    box->setEditable(true);
+    box->setInsertPolicy(QComboBox::NoInsert);
+    box->completer()->setCompletionMode(QCompleter::PopupCompletion);
+  }
 }
 
 bool View::DoDelay(MsgCode code) {
   if (!MW_->ui->animationOff->isChecked() && (code != MsgCode::succ_del) &&
-      (code != MsgCode::unsucc_del) && (code != MsgCode::empty_msg)) {
+      (code != MsgCode::unsucc_del) && (code != MsgCode::empty_msg) &&
+      (code != MsgCode::undo_done) && (code != MsgCode::redo_done) &&
+      (code != MsgCode::undo_empty) && (code != MsgCode::redo_empty)) {
     return true;
   }
   return false;
 }
 
-void View::HandleMsg(MsgCode code, const BareTrees &trees) {
-  trees_ = &trees;
+void View::HandleMsg(const MsgType &msg) {
+  trees_ = msg.trees;
+  overlay_ = msg.overlay;
+  // часы у модели одни, кадр без них не значит, что карта выключилась
+  if (msg.heat) {
+    heat_ = msg.heat;
+  }
+  if (msg.last) {
+    hot_tree_ = -1;
+  }
+  if (forest_executing_) {
+    // лес живет в отдельном слоте, во время запроса к лесу показываю его
+    for (int id = 0; id < trees_->Capacity(); ++id) {
+      if (trees_->ModeOf(id) == Trees::Mode::forest) {
+        main_tree_id_ = id;
+      }
+    }
+  }
   UpdateComboBox();
-  SetStatus(code);
+  SetStatus(msg.code, msg.results, msg.splay, msg.values);
   Prepare();
   Draw();
-  if (DoDelay(code)) {
+  if (DoDelay(msg.code)) {
     Delay(MW_->ui->delayTime->value());
   }
 }
 
+void View::Send(UserQuery query) {
+  port_out_.Set(std::move(query));
+  emit Idle();
+}
+
+void View::RunWorkload() {
+  Workload::Params params;
+  if (!Workload::Parse(MW_->ui->workloadSpec->text().toStdString(), &params)) {
+    QMessageBox::warning(NULL, QObject::tr("Ошибка"),
+                         QObject::tr(kWorkloadErrMsg));
+    return;
+  }
+  if (params.tree_id == -1) {
+    params.tree_id = main_tree_id_;
+  }
+  SetEnabledWidgets(false);
+  Workload workload{params};
+  UserQuery query;
+  // без анимации промежуточные кадры все равно не нужны, так что отправляю всю
+  // нагрузку одним пакетом. С splitmerge так не выйдет: ему нужны id
+  // деревьев, которые появляются по ходу выполнения
+  if (MW_->ui->animationOff->isChecked() &&
+      params.kind != Workload::Kind::split_merge) {
+    UserQuery batch{QueryType::batch, {params.tree_id, 0}};
+    while (workload.Next(*trees_, &query)) {
+      batch.batch.push_back(query);
+    }
+    Send(std::move(batch));
+  } else {
+    while (workload.Next(*trees_, &query)) {
+      Send(query);
+    }
+  }
+  SetEnabledWidgets(true);
+}
+
+void View::SetPolicy() {
+  UserQuery query{QueryType::policy, {main_tree_id_, 0}};
+  if (!SplayPolicy::Parse(MW_->ui->policySpec->text().toStdString(),
+                          &query.policy)) {
+    QMessageBox::warning(NULL, QObject::tr("Ошибка"),
+                         QObject::tr(kPolicyErrMsg));
+    return;
+  }
+  Send(query);
+}
+
+void View::RunSequence() {
+  UserQuery query{QueryType::do_nothing, {0, 0}};
+  if (!ParseSequenceQuery(MW_->ui->seqSpec->text().toStdString(),
+                          main_tree_id_, &query)) {
+    QMessageBox::warning(NULL, QObject::tr("Ошибка"),
+                         QObject::tr(kSequenceErrMsg));
+    return;
+  }
+  SetEnabledWidgets(false);
+  Send(query);
+  SetEnabledWidgets(true);
+}
+
+void View::RunRange() {
+  UserQuery query{QueryType::do_nothing, {0, 0}};
+  if (!ParseRangeQuery(MW_->ui->rangeSpec->text().toStdString(),
+                       main_tree_id_, &query)) {
+    QMessageBox::warning(NULL, QObject::tr("Ошибка"),
+                         QObject::tr(kRangeErrMsg));
+    return;
+  }
+  SetEnabledWidgets(false);
+  Send(query);
+  SetEnabledWidgets(true);
+}
+
+// файл читается и разбирается в фоне, чтобы окно не замирало на десятках
+// миллионов ключей, а процент в строке состояния приходит из потоков пула
+// через очередь событий. В модель ключи уходят уже в потоке GUI, как и любой
+// другой запрос
+void View::RunImport() {
+  auto path = QFileDialog::getOpenFileName(
+      MW_.get(), QObject::tr("Загрузить ключи"), {},
+      QObject::tr("Ключи (*.txt *.csv *.bin);;Все файлы (*)"));
+  if (path.isEmpty()) {
+    return;
+  }
+  SetEnabledWidgets(false);
+  int id = main_tree_id_;
+  auto result = std::make_shared<KeyFile::Result>();
+  auto watcher = new QFutureWatcher<bool>{this};
+  QObject::connect(
+      watcher, &QFutureWatcher<bool>::finished, this,
+      [this, watcher, result, id] {
+        watcher->deleteLater();
+        if (!watcher->result()) {
+          MW_->ui->statusbar->clearMessage();
+          QMessageBox::warning(NULL, QObject::tr("Ошибка"),
+                               QString::fromStdString(result->error));
+        } else {
+          UserQuery query{QueryType::load, {id, 0}};
+          query.keys = std::make_shared<const std::vector<int>>(
+              std::move(result->keys));
+          Send(std::move(query));
+        }
+        SetEnabledWidgets(true);
+      });
+  watcher->setFuture(QtConcurrent::run([this, path, result] {
+    return KeyFile::Read(path, KeyFile::Format::guess, result.get(),
+                         [this](int percent) {
+                           QMetaObject::invokeMethod(
+                               this,
+                               [this, percent] {
+                                 MW_->ui->statusbar->showMessage(
+                                     QObject::tr("Загрузка ключей: %1%")
+                                         .arg(percent));
+                               },
+                               Qt::QueuedConnection);
+                         });
+  }));
+}
+
+void View::RunForest() {
+  UserQuery query{QueryType::do_nothing, {0, 0}};
+  if (!ParseForestQuery(MW_->ui->forestSpec->text().toStdString(), &query)) {
+    QMessageBox::warning(NULL, QObject::tr("Ошибка"),
+                         QObject::tr(kForestErrMsg));
+    return;
+  }
+  query.animate = !MW_->ui->animationOff->isChecked();
+  SetEnabledWidgets(false);
+  forest_executing_ = true;
+  Send(query);
+  forest_executing_ = false;
+  SetEnabledWidgets(true);
+}
+
 void View::UpdateTreeId(int &tree_id) {
   // если дерева с номером tree_id уже не существует, то отрисовываю первое
   // попавшееся
-  if (trees_->find(tree_id) == trees_->end()) {
-    tree_id = trees_->begin()->first;
+  if (!trees_->Contains(tree_id)) {
+    tree_id = trees_->First();
   }
 }
 
 void View::ConnectComboBoxes() {
-  QObject::connect(MW_->ui->maintreeId, SIGNAL(currentTextChanged(QString)),
-                   this, SLOT(OnChoiceChange(QString)));
-  QObject::connect(MW_->ui->lefttreeId, SIGNAL(currentTextChanged(QString)),
-                   this, SLOT(OnMergeChoiceChange(QString)));
-  QObject::connect(MW_->ui->righttreeId, SIGNAL(currentTextChanged(QString)),
-                   this, SLOT(OnMergeChoiceChange(QString)));
-}
-
-void View::DisconnectComboBoxes() {
-  QObject::disconnect(MW_->ui->maintreeId, SIGNAL(currentTextChanged(QString)),
-                      this, SLOT(OnChoiceChange(QString)));
-  QObject::disconnect(MW_->ui->lefttreeId, SIGNAL(currentTextChanged(QString)),
-                      this, SLOT(OnMergeChoiceChange(QString)));
-  QObject::disconnect(MW_->ui->righttreeId, SIGNAL(currentTextChanged(QString)),
-                      this, SLOT(OnMergeChoiceChange(QString)));
+  // по currentIndexChanged, а не по тексту: в редактируемом комбобоксе текст
+  // меняется на каждую набранную цифру
+  QObject::connect(MW_->ui->maintreeId, SIGNAL(currentIndexChanged(int)),
+                   this, SLOT(OnChoiceChange(int)));
+  QObject::connect(MW_->ui->lefttreeId, SIGNAL(currentIndexChanged(int)),
+                   this, SLOT(OnMergeChoiceChange(int)));
+  QObject::connect(MW_->ui->righttreeId, SIGNAL(currentIndexChanged(int)),
+                   this, SLOT(OnMergeChoiceChange(int)));
 }
 
 void View::UpdateComboBox() {
-  QComboBox *maintree_combobox = MW_->ui->maintreeId,
-            *lefttree_combobox = MW_->ui->lefttreeId,
-            *righttree_combobox = MW_->ui->righttreeId;
-  DisconnectComboBoxes();
-  ClearBox(maintree_combobox);
-  ClearBox(lefttree_combobox);
-  ClearBox(righttree_combobox);
-  for (auto &[num, tree] : *trees_) {
-    InsertItem(maintree_combobox, num);
-    InsertItem(lefttree_combobox, num);
-    InsertItem(righttree_combobox, num);
-  }
+  // выбор здесь меняет модель, так что сигналы комбобоксов на это время глушу
+  QSignalBlocker main_blocker{MW_->ui->maintreeId},
+      left_blocker{MW_->ui->lefttreeId}, right_blocker{MW_->ui->righttreeId};
+  tree_list_.Sync(trees_);
   UpdateTreeId(main_tree_id_);
   UpdateTreeId(left_tree_id_);
   UpdateTreeId(right_tree_id_);
-  ConnectComboBoxes();
-  UpdComboBoxText(maintree_combobox, main_tree_id_);
-  UpdComboBoxText(lefttree_combobox, left_tree_id_);
-  UpdComboBoxText(righttree_combobox, right_tree_id_);
+  UpdComboBoxText(MW_->ui->maintreeId, main_tree_id_);
+  UpdComboBoxText(MW_->ui->lefttreeId, left_tree_id_);
+  UpdComboBoxText(MW_->ui->righttreeId, right_tree_id_);
 }
 
-void View::SetStatus(MsgCode code) {
+void View::SetStatus(MsgCode code, const std::vector<MsgCode> &results,
+                     const SplayStats *splay, const std::vector<int> &values) {
   std::string msg;
   if (code == MsgCode::split_succ) {
+    // правое дерево еще не зарегистрировано, оно получит id NextId()
     msg = "The left tree ID is " + std::to_string(main_tree_id_) +
-          ". The right is " + QString::number(next_id_).toStdString();
-    ++next_id_;
+          ". The right is " + std::to_string(trees_->NextId());
+  } else if (code == MsgCode::batch_done) {
+    msg = Text::GetMsg(code) + Text::BatchSummary(results);
   } else if (code == MsgCode::merge_end) {
     msg = Text::GetMsg(MsgCode::merge_end) + std::to_string(left_tree_id_);
+  } else if (!values.empty()) {
+    msg = Text::Answer(code, values);
+  } else if (splay) {
+    msg = Text::GetMsg(code) + ". " + Text::SplaySummary(*splay);
   } else {
     msg = Text::GetMsg(code);
   }
@@ -322,13 +720,11 @@ void View::SetStatus(MsgCode code) {
 }
 
 void View::Prepare() {
-  if (!merge_executing_) {
-    cur_tree_.Fill(trees_->at(main_tree_id_));
-  } else {
-    // если я выполняю мерж, то я всегда к левому дереву приливаю правое, так
-    // что беру left_tree_id_
-    cur_tree_.Fill(trees_->at(left_tree_id_));
-  }
+  // если я выполняю мерж, то я всегда к левому дереву приливаю правое, так
+  // что беру left_tree_id_
+  int id = merge_executing_ ? left_tree_id_ : main_tree_id_;
+  // пока дерево не менялось, его версия та же и раскладка берется из кэша
+  cur_tree_ = layouts_.Get(id, trees_->Version(id), layout_, (*trees_)[id]);
 }
 
 void View::Draw() {
@@ -338,120 +734,124 @@ void View::Draw() {
 
   QwtPlotLegendItem *leg = new QwtPlotLegendItem{};
   leg->attach(plot);
-  auto cur_tree = cur_tree_.Get();
-  if (cur_tree) {
-    if (cur_tree->node->state == State::hide_this) {
-      DrawTwoTrees(plot, cur_tree->left, cur_tree->right);
-    } else if (cur_tree->node->state == State::split_left) {
-      DrawTwoTrees(plot, cur_tree->left, cur_tree);
-    } else if (cur_tree->node->state == State::split_right) {
-      DrawTwoTrees(plot, cur_tree, cur_tree->right);
-    } else {
-      DrawOneTree(plot);
-    }
+
+  // само дерево рисуется плитками из кэша (hide_this и отрезанные при split
+  // ребра учитывает Snapshot), так что при панорамировании перерисовка - это
+  // просто сдвиг готовых картинок. Маркеры qwt остаются только у вершин,
+  // которые попадают в легенду
+  int font_sz = kFontSz * scale_;
+  tiles_.SetLook(detail::TileCache::Look{
+      ReadyTree::kRadius * 4 * scale_, font_sz >= kMinFontSz ? font_sz : 0,
+      !MW_->ui->animationOff->isChecked()});
+  auto root = cur_tree_ ? cur_tree_->Get() : nullptr;
+  bool heat = heat_ && MW_->ui->heatMap->isChecked();
+  tiles_.SetSnapshot(
+      Snapshot{root, MsgCode::empty_msg, overlay_, heat ? heat_ : nullptr});
+  (new detail::TileLayer{&tiles_})->attach(plot);
+  // в тепловой карте цветов состояний не видно, так что и легенда своя
+  if (heat) {
+    AttachHeat(root ? root->node : nullptr);
+  } else {
+    AttachLegend(root, State::regular,
+                 overlay_ ? overlay_->Collect() : Marks{});
   }
 
   plot->replot();
 }
 
-void View::DrawTwoTrees(QwtPlot *plot, PVNode left, PVNode right) {
-  QwtPlotCurve *cur = new QwtPlotCurve{}, *cur2 = new QwtPlotCurve{};
-  cur->setItemAttribute(QwtPlotItem::Legend, false);
-  cur2->setItemAttribute(QwtPlotItem::Legend, false);
-  QPolygonF left_points, right_points;
-
-  AddPoints(left_points, left);
-  cur->setSamples(left_points);
-  cur->attach(plot);
-
-  AddPoints(right_points, right);
-  cur2->setSamples(right_points);
-  cur2->attach(plot);
-}
-
-void View::DrawOneTree(QwtPlot *plot) {
-  QwtPlotCurve *cur = new QwtPlotCurve{};
-  cur->setItemAttribute(QwtPlotItem::Legend, false);
-  QPolygonF points;
-  AddPoints(points, cur_tree_.Get());
-
-  cur->setSamples(points);
-  cur->attach(plot);
-}
-
-void View::AddPoints(QPolygonF &points, PVNode vnode) {
+// цвет поддеревьев A, B, C, D наследуется всеми их вершинами (как в
+// Snapshot), а в легенду попадает только корень такого поддерева
+void View::AttachLegend(PVNode vnode, State inherited, const Marks &marks) {
   if (!vnode) {
     return;
   }
-
-  points << QPointF(vnode->x, vnode->y);
-  PushState(vnode);
-  if (vnode->node->state != State::split_left) {
-    AddPoints(points, vnode->left);
-    points << QPointF(vnode->x, vnode->y);
+  auto it = marks.find(vnode->node);
+  State state = it != marks.end() ? it->second : State::regular;
+  if (IsSubtreeState(inherited)) {
+    state = inherited;
   }
-  if (vnode->node->state != State::split_right) {
-    AddPoints(points, vnode->right);
-    points << QPointF(vnode->x, vnode->y);
+  if ((IsSubtreeState(state) && !IsSubtreeState(inherited)) ||
+      state == State::x_vertex || state == State::p_vertex ||
+      state == State::g_vertex) {
+    AttachVertex(vnode, state);
   }
-
-  AttachVertex(vnode, GetSymbol(vnode));
+  AttachLegend(vnode->left, state, marks);
+  AttachLegend(vnode->right, state, marks);
 }
 
-void View::AttachVertex(PVNode vnode, QwtSymbol *sym) {
+void View::AttachVertex(PVNode vnode, State state) {
   QwtPlotMarker *num = new QwtPlotMarker{};
 
   num->setValue(vnode->x, vnode->y);
-  num->setSymbol(sym);
-  QwtText txt = QwtText(QString(std::to_string(vnode->node->value).c_str()));
-  int font_sz = kFontSz * scale_;
-  QFont font{QString(kFont), font_sz};
-  txt.setFont(font);
-  num->setLabel(txt);
+  num->setSymbol(GetSymbol(vnode, state));
+  num->setLegendIconSize(QSize(kLegSz, kLegSz));
+  num->setTitle(Text::LegendByState(state).c_str());
+  num->setItemAttribute(QwtPlotItem::Legend, true);
+
+  num->attach(MW_->Plot());
+}
 
-  if ((IsSubtreeState(vnode->node) && !IsSubtreeState(vnode->node->par)) ||
-      vnode->node->state == State::x_vertex ||
-      vnode->node->state == State::p_vertex ||
-      vnode->node->state == State::g_vertex) {
-    num->setLegendIconSize(QSize(kLegSz, kLegSz));
-    num->setTitle(Text::LegendByState(vnode->node->state).c_str());
-    num->setItemAttribute(QwtPlotItem::Legend, true);
+// шкала логарифмическая, как в Snapshot, так что подписи легенды - веса на
+// границах ее третей. Средняя глубина горячих ключей против высоты дерева и
+// показывает, держит ли splay их у корня
+void View::AttachHeat(PNode root) {
+  if (hot_tree_ != main_tree_id_) {
+    hot_height_ = -1;
+    hot_ = heat_->Top(root, kHotKeys, &hot_height_);
+    hot_tree_ = main_tree_id_;
+    FillHotKeys();
+  }
+  double max = hot_.empty() ? 0 : hot_.front().heat;
+  int last = Palette::kHeatLevels - 1;
+  for (int level : {last, 2 * last / 3, last / 3, 0}) {
+    double value = std::expm1(std::log1p(max) * level / last);
+    (new detail::HeatLegendItem{QString::number(value, 'f', 1),
+                                Palette::HeatColor(level)})
+        ->attach(MW_->Plot());
   }
+}
 
-  num->attach(MW_->Plot());
+void View::FillHotKeys() {
+  auto list = MW_->ui->hotKeys;
+  list->clear();
+  if (hot_.empty()) {
+    return;
+  }
+  double depth = 0;
+  for (auto &hot : hot_) {
+    depth += hot.depth;
+  }
+  list->addItem(QObject::tr("Средняя глубина %1 при высоте %2")
+                    .arg(depth / hot_.size(), 0, 'f', 1)
+                    .arg(hot_height_));
+  for (auto &hot : hot_) {
+    list->addItem(QObject::tr("%1: вес %2, глубина %3")
+                      .arg(hot.key)
+                      .arg(hot.heat, 0, 'f', 1)
+                      .arg(hot.depth));
+  }
 }
 
-QwtSymbol *View::GetSymbol(PVNode vnode) {
-  QwtSymbol *sym = new QwtSymbol{QwtSymbol::Style::Ellipse};
+QwtSymbol *View::GetSymbol(PVNode vnode, State state) {
+  int font_sz = kFontSz * scale_;
+  QImage label;
+  if (font_sz >= kMinFontSz) {
+    label = detail::LabelCache::Instance().Get(vnode->node->value, font_sz);
+  }
+  QwtSymbol *sym = new LabeledSymbol{QwtSymbol::Style::Ellipse, label};
   int diam = ReadyTree::kRadius * 2;
   sym->setSize((diam * 4) * scale_, (diam * 4) * scale_);
   if (!MW_->ui->animationOff->isChecked()) {
-    sym->setColor(Palette::GetColor(vnode->node->state));
+    sym->setColor(Palette::GetColor(state));
   } else {
     sym->setColor(Palette::kDefaultColor);
   }
   return sym;
 }
 
-// пропихиваем state в ребенка чтобы закрасить все поддерево одним цветом
-void View::PushState(PVNode vnode) {
-  if (vnode->left && IsSubtreeState(vnode->node)) {
-    vnode->left->node->state = vnode->node->state;
-  }
-  if (vnode->right && IsSubtreeState(vnode->node)) {
-    vnode->right->node->state = vnode->node->state;
-  }
-}
-
-bool View::IsSubtreeState(PNode node) {
-  if (!node) {
-    return false;
-  }
-  if (node->state == State::a_subtree || node->state == State::b_subtree ||
-      node->state == State::c_subtree || node->state == State::d_subtree) {
-    return true;
-  }
-  return false;
+bool View::IsSubtreeState(State state) {
+  return state == State::a_subtree || state == State::b_subtree ||
+         state == State::c_subtree || state == State::d_subtree;
 }
 
 void View::Delay(double sWait) {
@@ -465,6 +865,8 @@ void View::Delay(double sWait) {
 }
 
 void View::SetEnabledWidgets(bool flag) {
+  disabled_ += flag ? -1 : 1;
+  flag = disabled_ == 0;
   MW_->ui->vertexId->setEnabled(flag);
   MW_->ui->maintreeId->setEnabled(flag);
   MW_->ui->lefttreeId->setEnabled(flag);
@@ -475,7 +877,25 @@ void View::SetEnabledWidgets(bool flag) {
   MW_->ui->splitButton->setEnabled(flag);
   MW_->ui->mergeButton->setEnabled(flag);
   MW_->ui->deltreeButton->setEnabled(flag);
+  MW_->ui->undoButton->setEnabled(flag);
+  MW_->ui->redoButton->setEnabled(flag);
   MW_->ui->animationOff->setEnabled(flag);
+  MW_->ui->compactLayout->setEnabled(flag);
+  MW_->ui->heatMap->setEnabled(flag);
+  MW_->ui->heatHalfLife->setEnabled(flag);
+  MW_->ui->workloadSpec->setEnabled(flag);
+  MW_->ui->workloadButton->setEnabled(flag);
+  MW_->ui->policySpec->setEnabled(flag);
+  MW_->ui->policyButton->setEnabled(flag);
+  MW_->ui->seqSpec->setEnabled(flag);
+  MW_->ui->seqButton->setEnabled(flag);
+  MW_->ui->forestSpec->setEnabled(flag);
+  MW_->ui->forestButton->setEnabled(flag);
+  MW_->ui->rangeSpec->setEnabled(flag);
+  MW_->ui->rangeButton->setEnabled(flag);
+  MW_->ui->importButton->setEnabled(flag);
+  MW_->ui->traceButton->setEnabled(flag);
+  MW_->ui->optimalButton->setEnabled(flag);
 }
 
 QString View::GetText(QComboBox *ptr) {
@@ -485,22 +905,13 @@ QString View::GetText(QComboBox *ptr) {
   return "";
 }
 
-void View::ClearBox(QComboBox *ptr) {
-  if (ptr) {
-    ptr->clear();
-  }
-}
-
-void View::InsertItem(QComboBox *ptr, int num) {
-  if (ptr) {
-    ptr->addItem(std::to_string(num).c_str());
-  }
-}
-
 void View::UpdComboBoxText(QComboBox *ptr, int cur_id) {
-  // вообще findText может вернуть -1, если не нашел такой строки
-  // но я гарантирую, что существует дерево с номером cur_id
-  ptr->setCurrentIndex(ptr->findText(QString::number(cur_id)));
+  // дерево с номером cur_id существует (см. UpdateTreeId), так что строка
+  // найдется
+  int row = tree_list_.RowOf(cur_id);
+  if (ptr->currentIndex() != row) {
+    ptr->setCurrentIndex(row);
+  }
 }
 
 } // namespace DSViz
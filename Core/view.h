@@ -1,12 +1,25 @@
 #ifndef VIEW_H
 #define VIEW_H
 #include "App/mainwindow.h"
+#include "Common/forest.h"
 #include "Common/node.h"
 #include "Common/query.h"
+#include "Common/range.h"
+#include "Common/sequence.h"
+#include "Core/frame.h"
+#include "Core/keyfile.h"
+#include "Core/tiles.h"
+#include "Core/treelist.h"
+#include "Core/trees.h"
 #include "Core/vnode.h"
+#include "Core/workload.h"
 #include "Observer/observer.h"
 #include <QComboBox>
+#include <QImage>
 #include <QTimer>
+#include <mutex>
+#include <tuple>
+#include <qwt_graphic.h>
 #include <qwt_plot.h>
 #include <qwt_plot_panner.h>
 #include <qwt_symbol.h>
@@ -18,8 +31,11 @@ namespace detail {
 class Palette {
 public:
   static QColor GetColor(State state);
+  // тепловая карта: от синего (level 0, холодно) до красного
+  static QColor HeatColor(int level);
 
   constexpr static const QColor kDefaultColor = QColorConstants::Gray;
+  constexpr static const int kHeatLevels = 16;
 
 private:
   // constexpr сделать не выйдет, у std::map нет constexpr конструктора
@@ -38,7 +54,8 @@ private:
       {State::dont_rem, QColor::fromRgb(255, 0, 0)},
       {State::do_remove, QColor::fromRgb(0, 255, 0)},
       {State::inserted, QColor::fromRgb(0, 255, 255)},
-      {State::new_root, QColor::fromRgb(255, 215, 0)}};
+      {State::new_root, QColor::fromRgb(255, 215, 0)},
+      {State::push_tag, QColor::fromRgb(0, 102, 204)}};
 };
 
 class Text {
@@ -47,6 +64,13 @@ public:
 
   static std::string LegendByState(State state);
 
+  static std::string BatchSummary(const std::vector<MsgCode> &results);
+
+  static std::string SplaySummary(const SplayStats &stats);
+
+  // ответ на запрос к лесу, values - из Frame
+  static std::string Answer(MsgCode code, const std::vector<int> &values);
+
 private:
   inline static const std::map<MsgCode, const char *> StrMsg = {
       {MsgCode::OK, "OK"},
@@ -82,9 +106,100 @@ private:
        "ID of the left tree must be != ID of the right one"},
       {MsgCode::merge_empty, "Both trees must not be empty"},
       {MsgCode::merge_end, "Merge has been executed. The new root is "},
+      {MsgCode::batch_done, "Batch has been executed: "},
+      {MsgCode::undo_done, "The last operation has been undone"},
+      {MsgCode::redo_done, "The operation has been redone"},
+      {MsgCode::undo_empty, "There is nothing to undo"},
+      {MsgCode::redo_empty, "There is nothing to redo"},
+      {MsgCode::frozen, "The tree has been frozen: finds in batches will not "
+                        "splay it"},
+      {MsgCode::policy_set, "Splay policy has been set"},
+      {MsgCode::mode_err,
+       "ERROR: The operation doesn't match the tree mode (values/sequence)"},
+      {MsgCode::index_err, "ERROR: Wrong position in the sequence"},
+      {MsgCode::seq_mode, "The tree is a sequence now: keys are positions"},
+      {MsgCode::push_perf,
+       "Pending reverse/add of the vertex is pushed to its children"},
+      {MsgCode::range_perf,
+       "The segment is gathered in one subtree and its root gets the tag"},
+      {MsgCode::vertex_err, "ERROR: Wrong vertex number"},
+      {MsgCode::link_err,
+       "ERROR: The vertices are already connected, link would make a cycle"},
+      {MsgCode::cut_err, "ERROR: There is no such edge in the forest"},
+      {MsgCode::forest_root, "The root is "},
+      {MsgCode::connected, "The vertices are connected"},
+      {MsgCode::disconnected, "The vertices are not connected"},
+      {MsgCode::path_done, "Path: "},
+      {MsgCode::range_err,
+       "ERROR: The left end of the range must not exceed the right one"},
+      {MsgCode::range_empty, "There are no keys in the range"},
+      {MsgCode::extract_done, "The range has been moved to the tree "},
+      {MsgCode::erase_done, "Keys removed: "},
+      {MsgCode::neighbour, "The key is "},
+      {MsgCode::load_done, "The keys have been loaded into the tree "},
+      {MsgCode::trace_on, "Recording finds"},
+      {MsgCode::trace_off, "Finds recorded: "},
+      {MsgCode::trace_empty, "No finds have been recorded for this tree"},
+      {MsgCode::optimal_done, "The static tree is "},
+      {MsgCode::heat_set, "Heat decay has been set"},
+      {MsgCode::heat_on, "Counting accesses"},
+      {MsgCode::heat_off, "Access counts have been dropped"},
       {MsgCode::empty_msg, ""}};
 };
 
+// кэш отрисованных подписей вершин. Раньше на каждый кадр для каждой вершины
+// заново собирались QFont и QwtText, и перерисовка большого дерева почти
+// целиком уходила на раскладку текста. Теперь подпись растеризуется один раз
+// для пары (значение, размер шрифта), а дальше просто копируется на полотно
+//
+// Кэш один на программу: плитки (TileCache) и кадры headless режима
+// (Snapshot) рисуются на пуле потоков, поэтому подписи - это QImage, а не
+// QPixmap, и доступ под мьютексом
+class LabelCache {
+public:
+  static LabelCache &Instance();
+
+  // pixels = false - размер шрифта в пунктах, как у подписей в окне, иначе в
+  // пикселях (Snapshot подгоняет подпись под радиус вершины)
+  QImage Get(int value, int font_sz, bool pixels = false);
+
+  static constexpr const int kMaxSize = 1 << 14;
+
+private:
+  explicit LabelCache(const char *family);
+
+  QString family_;
+  std::mutex mutex_;
+  std::map<std::tuple<int, int, bool>, QImage> cache_;
+};
+
+// обычный символ вершины, поверх которого рисуется готовая подпись
+class LabeledSymbol : public QwtSymbol {
+public:
+  LabeledSymbol(Style style, QImage label);
+
+protected:
+  void renderSymbols(QPainter *painter, const QPointF *points,
+                     int num_points) const override;
+
+private:
+  QImage label_;
+};
+
+// строка легенды тепловой карты: на полотне ничего не рисует, в легенде -
+// квадрат цвета одного уровня
+class HeatLegendItem : public QwtPlotItem {
+public:
+  HeatLegendItem(const QString &title, QColor color);
+
+  void draw(QPainter *painter, const QwtScaleMap &x_map,
+            const QwtScaleMap &y_map, const QRectF &canvas) const override;
+  QwtGraphic legendIcon(int index, const QSizeF &size) const override;
+
+private:
+  QColor color_;
+};
+
 class CustomPanner : public QwtPlotPanner {
 
 public:
@@ -102,11 +217,13 @@ class View : public QObject {
   using CustomPanner = detail::CustomPanner;
   using Palette = detail::Palette;
   using Text = detail::Text;
+  using LabeledSymbol = detail::LabeledSymbol;
   using PVNode = VNode<int> *;
   using PNode = Node<int> *;
-  using BareTrees = std::map<int, PNode>;
-  using MsgType = std::pair<MsgCode, BareTrees>;
+  using BareTrees = detail::Trees;
+  using MsgType = Frame;
   using UserQuery = UserQuery<int>;
+  using Marks = std::unordered_map<const Node<int> *, State>;
 
   auto GetCallback();
 
@@ -120,67 +237,117 @@ public:
   static constexpr const char *kFont = "Monaco";
   static constexpr const char *kErrMsg =
       "Номер дерева и/или вершины - не число";
+  static constexpr const char *kWorkloadErrMsg =
+      "Некорректное описание нагрузки";
+  static constexpr const char *kPolicyErrMsg =
+      "Некорректная политика splay";
+  static constexpr const char *kSequenceErrMsg =
+      "Некорректная команда последовательности";
+  static constexpr const char *kForestErrMsg = "Некорректная команда леса";
+  static constexpr const char *kRangeErrMsg =
+      "Некорректная команда над отрезком ключей";
   static constexpr const int kFontSz = 18;
+  // при меньшем размере шрифта подпись все равно не прочитать, так что ее не
+  // рисую вообще
+  static constexpr const int kMinFontSz = 6;
   static constexpr const int kLegSz = 10;
+  static constexpr const int kHotKeys = 10;
   static constexpr const int kBound = 40;
   static constexpr const double kSliderBegin = 1.0;
   static constexpr const double kSliderLowerBound = 0.2;
   static constexpr const double kSliderUpperBound = 2.0;
 
+signals:
+  // запрос окна выполнен, модель свободна: сервер (см. Server::Resume) может
+  // выполнить то, что пришло через сокет за время анимации
+  void Idle();
+
 public slots:
+  // через сокет выполняется запрос: его кадры рисуются здесь же, и пока идет
+  // анимация, кнопки окна выключены
+  void OnRemote(bool running);
   void OnPanned(int dx, int dy);
   void OnPauseOrStop();
   void OnButtonClick();
   void OnZoom(double value);
-  void OnChoiceChange(QString num);
-  void OnMergeChoiceChange(QString num);
+  void OnChoiceChange(int row);
+  void OnMergeChoiceChange(int row);
+  void OnLayoutChange(bool compact);
+  void OnHeatChange(bool on);
+  void OnHeatDecay();
 
 private:
   void ConnectWidgets();
   void ConfigureWidgets();
   bool DoDelay(MsgCode code);
-  void HandleMsg(MsgCode code, const BareTrees &trees);
+  void HandleMsg(const MsgType &msg);
+  // отправляет запрос контроллеру и сообщает, что модель свободна (Idle)
+  void Send(UserQuery query);
+  void RunWorkload();
+  void SetPolicy();
+  void RunSequence();
+  void RunForest();
+  void RunRange();
+  void RunImport();
 
   void UpdateTreeId(int &tree_id);
   void ConnectComboBoxes();
-  void DisconnectComboBoxes();
   void UpdateComboBox();
 
-  void SetStatus(MsgCode code);
+  void SetStatus(MsgCode code, const std::vector<MsgCode> &results = {},
+                 const SplayStats *splay = nullptr,
+                 const std::vector<int> &values = {});
   void Prepare();
 
   void Draw();
-  void DrawTwoTrees(QwtPlot *plot, PVNode left, PVNode right);
-  void DrawOneTree(QwtPlot *plot);
-  void AddPoints(QPolygonF &points, PVNode vnode);
-  void AttachVertex(PVNode vnode, QwtSymbol *sym);
-
-  QwtSymbol *GetSymbol(PVNode vnode);
-  void PushState(PVNode vnode);
-  bool IsSubtreeState(PNode node);
+  void AttachLegend(PVNode vnode, State inherited, const Marks &marks);
+  void AttachVertex(PVNode vnode, State state);
+  // легенда тепловой карты и список самых горячих ключей дерева root.
+  // Список считается заново только после операции или смены дерева
+  void AttachHeat(PNode root);
+  void FillHotKeys();
+
+  QwtSymbol *GetSymbol(PVNode vnode, State state);
+  static bool IsSubtreeState(State state);
   void Delay(double sWait);
+  // вызовы парные, а выключать кнопки могут сразу несколько: свой запрос,
+  // импорт в фоне и запрос через сокет. Включаются они, когда закончили все
   void SetEnabledWidgets(bool flag);
 
   static QString GetText(QComboBox *ptr);
 
-  static void ClearBox(QComboBox *ptr);
-
-  static void InsertItem(QComboBox *ptr, int num);
-
-  static void UpdComboBoxText(QComboBox *ptr, int cur_id);
+  void UpdComboBoxText(QComboBox *ptr, int cur_id);
 
   // data
-  ReadyTree cur_tree_ = {};
+  // раскладка показанного дерева лежит в кэше, cur_tree_ указывает в него
+  detail::LayoutCache layouts_ = {};
+  ReadyTree *cur_tree_ = {};
+  ReadyTree::Layout layout_ = ReadyTree::Layout::weight;
+  detail::TileCache tiles_ = {};
   const BareTrees *trees_ = {};
+  // состояния вершин последнего кадра
+  const detail::Overlay *overlay_ = {};
+  // веса вершин последнего кадра
+  const detail::HeatClock *heat_ = {};
+  // самые горячие ключи дерева hot_tree_ на конец последней операции:
+  // HeatClock::Top обходит все дерево, на каждый кадр анимации это дорого.
+  // hot_tree_ = -1 - список устарел
+  std::vector<detail::HeatClock::Hot> hot_ = {};
+  int hot_height_ = -1;
+  int hot_tree_ = -1;
+  // общая модель трех комбобоксов, должна пережить окно
+  detail::TreeList tree_list_ = {};
   std::unique_ptr<MainWindow> MW_;
   std::unique_ptr<CustomPanner> panner_;
   QTimer timer_;
   double scale_ = 1;
   bool stopped_ = {};
   bool merge_executing_ = {};
+  bool forest_executing_ = {};
+  // сколько раз кнопки выключены (см. SetEnabledWidgets)
+  int disabled_ = {};
   int x_ = {};
   int y_ = {};
-  int next_id_ = 1;
   int main_tree_id_ = 0;
   int left_tree_id_ = 0;
   int right_tree_id_ = 0;
@@ -1,4 +1,5 @@
 #include "vnode.h"
+#include <algorithm>
 
 namespace DSViz {
 
@@ -8,18 +9,30 @@ ReadyTree::~ReadyTree() { Destroy(tree_); }
 
 void ReadyTree::Fill(PNode src, int x0, int y0) {
   Destroy(tree_);
+  size_ = 0;
   if (!src) {
     tree_ = nullptr;
     return;
   }
   tree_ = new VNode<int>{};
+  if (layout_ == Layout::tidy) {
+    FillY(src, tree_, y0);
+    Tidy(tree_);
+    FillX_Tidy(tree_, x0);
+    return;
+  }
   FillY_Weight(src, tree_, y0);
   FillX(tree_, x0);
 }
 
+void ReadyTree::SetLayout(Layout layout) { layout_ = layout; }
+
 ReadyTree::PVNode ReadyTree::Get() { return tree_; }
 
+size_t ReadyTree::Size() const { return size_; }
+
 void ReadyTree::FillY_Weight(PNode src, PVNode dst, int y) {
+  ++size_;
   dst->node = src;
   dst->y = y;
   int lwidth = kRadius, rwidth = kRadius;
@@ -65,6 +78,116 @@ void ReadyTree::UpdNode(PVNode node) {
   }
 }
 
+void ReadyTree::FillY(PNode src, PVNode dst, int y) {
+  ++size_;
+  dst->node = src;
+  dst->y = y;
+  if (src->left) {
+    dst->left = new VNode<int>{};
+    FillY(src->left, dst->left, y - 2 * kRadius - kVerSpace);
+  }
+  if (src->right) {
+    dst->right = new VNode<int>{};
+    FillY(src->right, dst->right, y - 2 * kRadius - kVerSpace);
+  }
+}
+
+// раскладка Рейнгольда-Тилфорда. Поддеревья раскладываются независимо, а потом
+// сдвигаются друг к другу настолько, насколько позволяют их контуры (правый
+// контур левого поддерева и левый контур правого). Проход по контурам идет
+// только до высоты более низкого поддерева, а дальше контур продолжается
+// нитью, так что суммарно все работает за O(n)
+ReadyTree::Extremes ReadyTree::Tidy(PVNode dst) {
+  auto left = dst->left, right = dst->right;
+  if (!left && !right) {
+    return {dst, 0, dst, 0};
+  }
+  if (!left || !right) {
+    // единственного сына все равно немного сдвигаю в его сторону (как и в
+    // обычной раскладке), чтобы было видно, левый он или правый
+    auto child = left ? left : right;
+    auto ext = Tidy(child);
+    child->offset = left ? -kRadius / 2 : kRadius / 2;
+    return {ext.lmost, ext.lmost_x + child->offset, ext.rmost,
+            ext.rmost_x + child->offset};
+  }
+
+  auto lext = Tidy(left);
+  auto rext = Tidy(right);
+
+  // x вершин на контурах считаются относительно корней left и right
+  // соответственно, sep - расстояние между этими корнями
+  PVNode li = left, ri = right;
+  int lx = 0, rx = 0;
+  int sep = kMinSep;
+  while (li && ri) {
+    sep = std::max(sep, kMinSep + lx - rx);
+    auto [lnext, loff] = NextRight(li);
+    auto [rnext, roff] = NextLeft(ri);
+    li = lnext;
+    lx += loff;
+    ri = rnext;
+    rx += roff;
+  }
+  // чтобы дети стояли симметрично относительно родителя
+  sep += sep % 2;
+  left->offset = -sep / 2;
+  right->offset = sep / 2;
+
+  Extremes res = {lext.lmost, lext.lmost_x + left->offset, rext.rmost,
+                  rext.rmost_x + right->offset};
+  if (li) {
+    // левое поддерево глубже: правый контур продолжается в левом поддереве
+    rext.rmost->thread = li;
+    rext.rmost->thread_off = (lx + left->offset) - res.rmost_x;
+    res.rmost = lext.rmost;
+    res.rmost_x = lext.rmost_x + left->offset;
+  } else if (ri) {
+    // правое глубже: левый контур продолжается в правом поддереве
+    lext.lmost->thread = ri;
+    lext.lmost->thread_off = (rx + right->offset) - res.lmost_x;
+    res.lmost = rext.lmost;
+    res.lmost_x = rext.lmost_x + right->offset;
+  }
+  return res;
+}
+
+void ReadyTree::FillX_Tidy(PVNode dst, int x) {
+  dst->x = x;
+  dst->x_min = dst->x_max = x;
+  if (dst->left) {
+    FillX_Tidy(dst->left, x + dst->left->offset);
+    dst->x_min = std::min(dst->x_min, dst->left->x_min);
+    dst->x_max = std::max(dst->x_max, dst->left->x_max);
+  }
+  if (dst->right) {
+    FillX_Tidy(dst->right, x + dst->right->offset);
+    dst->x_min = std::min(dst->x_min, dst->right->x_min);
+    dst->x_max = std::max(dst->x_max, dst->right->x_max);
+  }
+  dst->width = dst->x_max - dst->x_min + 2 * kRadius;
+}
+
+std::pair<ReadyTree::PVNode, int> ReadyTree::NextLeft(PVNode node) {
+  if (node->left) {
+    return {node->left, node->left->offset};
+  }
+  if (node->right) {
+    return {node->right, node->right->offset};
+  }
+  return {node->thread, node->thread_off};
+}
+
+std::pair<ReadyTree::PVNode, int> ReadyTree::NextRight(PVNode node) {
+  if (node->right) {
+    return {node->right, node->right->offset};
+  }
+  if (node->left) {
+    return {node->left, node->left->offset};
+  }
+  return {node->thread, node->thread_off};
+}
+
 void ReadyTree::Destroy(PVNode root) {
   if (!root) {
     return;
@@ -74,6 +197,54 @@ void ReadyTree::Destroy(PVNode root) {
   delete root;
 }
 
+ReadyTree *LayoutCache::Get(int id, uint64_t version,
+                            ReadyTree::Layout layout, PNode root) {
+  Key key{id, version, layout};
+  auto found = index_.find(key);
+  if (found != index_.end()) {
+    lru_.splice(lru_.begin(), lru_, found->second);
+    return lru_.front().tree.get();
+  }
+
+  // раскладки более старых версий этого дерева уже никому не нужны (ключи
+  // упорядочены по id, так что они лежат подряд)
+  for (auto it = index_.lower_bound(Key{id, 0, ReadyTree::Layout::weight});
+       it != index_.end() && std::get<0>(it->first) == id;) {
+    if (std::get<1>(it->first) < version) {
+      auto old = it->second;
+      ++it;
+      erase(old);
+    } else {
+      ++it;
+    }
+  }
+
+  auto tree = std::make_unique<ReadyTree>();
+  tree->SetLayout(layout);
+  tree->Fill(root);
+  nodes_ += tree->Size();
+  lru_.push_front(Entry{key, std::move(tree)});
+  index_[key] = lru_.begin();
+  // только что построенную раскладку не выбрасываю, даже если она одна больше
+  // лимита
+  while (nodes_ > kMaxNodes && lru_.size() > 1) {
+    erase(std::prev(lru_.end()));
+  }
+  return lru_.front().tree.get();
+}
+
+void LayoutCache::Clear() {
+  lru_.clear();
+  index_.clear();
+  nodes_ = 0;
+}
+
+void LayoutCache::erase(std::list<Entry>::iterator it) {
+  nodes_ -= it->tree->Size();
+  index_.erase(it->key);
+  lru_.erase(it);
+}
+
 } // namespace detail
 
 } // namespace DSViz
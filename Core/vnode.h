@@ -2,6 +2,12 @@
 #define VNODE_H
 #include "Common/node.h"
 #include <QColor>
+#include <cstdint>
+#include <list>
+#include <map>
+#include <memory>
+#include <tuple>
+#include <utility>
 
 namespace DSViz {
 
@@ -11,6 +17,11 @@ template <typename T> struct VNode {
   VNode<T> *left, *right;
   int x, y, width, x_max, x_min;
   QColor col;
+  // нужны только для компактной раскладки: сдвиг по x относительно родителя
+  // и нить контура (следующая вершина контура уровнем ниже) со сдвигом до нее
+  int offset;
+  VNode<T> *thread;
+  int thread_off;
 };
 
 namespace detail {
@@ -19,25 +30,86 @@ class ReadyTree {
   using PNode = Node<int> *;
   using PVNode = VNode<int> *;
 
+  // крайние (самые глубокие) вершины левого и правого контура поддерева,
+  // x считается относительно корня поддерева
+  struct Extremes {
+    PVNode lmost;
+    int lmost_x;
+    PVNode rmost;
+    int rmost_x;
+  };
+
 public:
+  enum class Layout {
+    // ширина поддерева = сумма ширин детей
+    weight,
+    // компактная раскладка Рейнгольда-Тилфорда
+    tidy
+  };
+
   ~ReadyTree();
 
   void Fill(PNode src, int x0 = 0, int y0 = 0);
 
+  void SetLayout(Layout layout);
+
   PVNode Get();
+  // число вершин раскладки
+  size_t Size() const;
 
   static constexpr const int kRadius = 6;
   static constexpr const int kHorSpace = 2;
   static constexpr const int kVerSpace = 2;
+  // минимальное расстояние между центрами соседних вершин на одном уровне
+  static constexpr const int kMinSep = 2 * kRadius + kHorSpace;
 
 private:
   void FillY_Weight(PNode src, PVNode dst, int y);
   void FillX(PVNode dst, int x);
   void UpdNode(PVNode node);
 
+  void FillY(PNode src, PVNode dst, int y);
+  Extremes Tidy(PVNode dst);
+  void FillX_Tidy(PVNode dst, int x);
+
+  static std::pair<PVNode, int> NextLeft(PVNode node);
+  static std::pair<PVNode, int> NextRight(PVNode node);
+
   void Destroy(PVNode root);
 
   PVNode tree_ = nullptr;
+  size_t size_ = {};
+  Layout layout_ = Layout::weight;
+};
+
+// готовые раскладки деревьев по ключу (id, версия, раскладка). Версию дерева
+// модель меняет при любом его изменении (Trees::Version), так что при
+// переключении на дерево, которое с прошлого раза не менялось, раскладка
+// берется готовой. Старые раскладки выбрасываются по LRU, когда суммарно в
+// кэше больше kMaxNodes вершин
+class LayoutCache {
+  using PNode = Node<int> *;
+
+public:
+  ReadyTree *Get(int id, uint64_t version, ReadyTree::Layout layout,
+                 PNode root);
+  void Clear();
+
+  static constexpr const size_t kMaxNodes = size_t{1} << 20;
+
+private:
+  using Key = std::tuple<int, uint64_t, ReadyTree::Layout>;
+  struct Entry {
+    Key key;
+    std::unique_ptr<ReadyTree> tree;
+  };
+
+  void erase(std::list<Entry>::iterator it);
+
+  // в начале - последние использованные
+  std::list<Entry> lru_;
+  std::map<Key, std::list<Entry>::iterator> index_;
+  size_t nodes_ = {};
 };
 
 } // namespace detail
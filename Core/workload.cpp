@@ -0,0 +1,152 @@
+#include "Core/workload.h"
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <numeric>
+#include <sstream>
+
+namespace DSViz {
+
+Workload::Workload(const Params &params) : params_{params}, rng_{params.seed} {
+  params_.keys = std::max(params_.keys, 1);
+  params_.window = std::max(std::min(params_.window, params_.keys), 1);
+  if (params_.kind == Kind::zipf) {
+    cdf_.resize(params_.keys);
+    double sum = 0;
+    for (int rank = 0; rank < params_.keys; ++rank) {
+      sum += 1.0 / std::pow(rank + 1, params_.skew);
+      cdf_[rank] = sum;
+    }
+    for (auto &val : cdf_) {
+      val /= sum;
+    }
+    perm_.resize(params_.keys);
+    std::iota(perm_.begin(), perm_.end(), params_.start);
+    std::shuffle(perm_.begin(), perm_.end(), rng_);
+  }
+}
+
+bool Workload::Next(const Trees &trees, UserQuery *query) {
+  if (issued_ >= params_.count) {
+    return false;
+  }
+  int id = params_.tree_id;
+
+  if (params_.kind == Kind::split_merge) {
+    // сливаю обратно то, что отрезал прошлый split. Если split не удался
+    // (дерево было пустым), то и сливать нечего
+    if (merge_next_) {
+      merge_next_ = false;
+      ++issued_;
+      if (trees.Contains(right_id_) && right_id_ != id) {
+        *query = UserQuery{QueryType::merge, {id, right_id_}};
+        return true;
+      }
+      return Next(trees, query);
+    }
+    merge_next_ = true;
+    right_id_ = trees.NextId();
+    *query = UserQuery{QueryType::split, {id, NextKey()}};
+    return true;
+  }
+
+  ++issued_;
+  *query = UserQuery{params_.op, {id, NextKey()}};
+  return true;
+}
+
+int Workload::NextKey() {
+  switch (params_.kind) {
+  case Kind::sequential:
+    return params_.start + issued_ % params_.keys;
+  case Kind::reverse:
+    return params_.start + params_.keys - 1 - issued_ % params_.keys;
+  case Kind::zipf:
+    return perm_[ZipfRank()];
+  case Kind::working_set: {
+    // окно сдвигается на drift после каждых window запросов и по кругу
+    // обходит весь диапазон ключей
+    long long shift = 1LL * (issued_ / params_.window) * params_.drift;
+    int base = static_cast<int>(shift % params_.keys);
+    int offset = std::uniform_int_distribution<int>{0, params_.window - 1}(rng_);
+    return params_.start + (base + offset) % params_.keys;
+  }
+  default:
+    return params_.start +
+           std::uniform_int_distribution<int>{0, params_.keys - 1}(rng_);
+  }
+}
+
+int Workload::ZipfRank() {
+  double val = std::uniform_real_distribution<double>{0.0, 1.0}(rng_);
+  auto it = std::lower_bound(cdf_.begin(), cdf_.end(), val);
+  if (it == cdf_.end()) {
+    --it;
+  }
+  return static_cast<int>(it - cdf_.begin());
+}
+
+bool Workload::Parse(const std::string &spec, Params *params) {
+  static const std::map<std::string, Kind> kKinds = {
+      {"seq", Kind::sequential},     {"reverse", Kind::reverse},
+      {"uniform", Kind::uniform},    {"zipf", Kind::zipf},
+      {"window", Kind::working_set}, {"splitmerge", Kind::split_merge}};
+  static const std::map<std::string, QueryType> kOps = {
+      {"insert", QueryType::insert},
+      {"remove", QueryType::remove},
+      {"find", QueryType::find}};
+
+  std::istringstream stream{spec};
+  std::string token;
+  if (!(stream >> token) || kKinds.find(token) == kKinds.end()) {
+    return false;
+  }
+  Params res;
+  res.kind = kKinds.at(token);
+  // последовательные нагрузки обычно нужны, чтобы наполнить дерево
+  if (res.kind == Kind::sequential || res.kind == Kind::reverse) {
+    res.op = QueryType::insert;
+  }
+
+  while (stream >> token) {
+    auto eq = token.find('=');
+    if (eq == std::string::npos) {
+      return false;
+    }
+    std::string key = token.substr(0, eq);
+    std::istringstream value{token.substr(eq + 1)};
+    bool ok = true;
+    if (key == "count") {
+      ok = static_cast<bool>(value >> res.count);
+    } else if (key == "keys") {
+      ok = static_cast<bool>(value >> res.keys);
+    } else if (key == "start") {
+      ok = static_cast<bool>(value >> res.start);
+    } else if (key == "seed") {
+      ok = static_cast<bool>(value >> res.seed);
+    } else if (key == "skew") {
+      ok = static_cast<bool>(value >> res.skew);
+    } else if (key == "window") {
+      ok = static_cast<bool>(value >> res.window);
+    } else if (key == "drift") {
+      ok = static_cast<bool>(value >> res.drift);
+    } else if (key == "tree") {
+      ok = static_cast<bool>(value >> res.tree_id);
+    } else if (key == "op") {
+      auto it = kOps.find(value.str());
+      ok = it != kOps.end();
+      if (ok) {
+        res.op = it->second;
+      }
+    } else {
+      ok = false;
+    }
+    if (!ok) {
+      return false;
+    }
+  }
+  *params = res;
+  return true;
+}
+
+} // namespace DSViz
@@ -0,0 +1,67 @@
+#ifndef WORKLOAD_H
+#define WORKLOAD_H
+#include "Common/query.h"
+#include "Core/trees.h"
+#include <random>
+#include <string>
+#include <vector>
+
+namespace DSViz {
+
+// генератор синтетической нагрузки. Выдает запросы по одному через Next, так
+// что его можно использовать и из View, и из headless режима. Описывается
+// строкой вида
+//
+//   zipf count=10000 keys=1000 skew=1.2 seed=7 op=find tree=0
+//
+// виды нагрузки: seq, reverse, uniform, zipf, window, splitmerge
+class Workload {
+  using Trees = detail::Trees;
+  using UserQuery = UserQuery<int>;
+
+public:
+  enum class Kind { sequential, reverse, uniform, zipf, working_set, split_merge };
+
+  struct Params {
+    Kind kind = Kind::uniform;
+    // сколько запросов выдать (для splitmerge - сколько пар split + merge)
+    int count = 1000;
+    // ключи берутся из [start, start + keys)
+    int keys = 1000;
+    int start = 0;
+    unsigned seed = 0;
+    // показатель распределения Ципфа
+    double skew = 1.0;
+    // размер скользящего рабочего множества и на сколько оно сдвигается после
+    // каждых window запросов
+    int window = 64;
+    int drift = 16;
+    QueryType op = QueryType::find;
+    // -1 - дерево выбирает тот, кто запускает нагрузку
+    int tree_id = -1;
+  };
+
+  explicit Workload(const Params &params);
+
+  // false, если запросы кончились
+  bool Next(const Trees &trees, UserQuery *query);
+
+  static bool Parse(const std::string &spec, Params *params);
+
+private:
+  int NextKey();
+  int ZipfRank();
+
+  Params params_;
+  std::mt19937 rng_;
+  // для zipf: функция распределения по рангам и перестановка ранг -> ключ,
+  // чтобы горячие ключи не шли подряд
+  std::vector<double> cdf_;
+  std::vector<int> perm_;
+  int issued_ = {};
+  int right_id_ = -1;
+  bool merge_next_ = {};
+};
+
+} // namespace DSViz
+#endif // WORKLOAD_H
@@ -1,4 +1,4 @@
-QT       += core gui
+QT       += core gui concurrent network svg
 
 greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 include ( ./qwt/qwt.prf )
@@ -11,8 +11,8 @@ CONFIG += exceptions_off
 
 CONFIG(debug, debug|release) {
   ## код для дебага
-  SOURCES += Debug/debug.cpp
-  HEADERS += Debug/debug.h
+  ## в дебаге лог пишет все, включая каждый поворот
+  DEFINES += DSVIZ_LOG_LEVEL=0
 } else {
   ## код для релиза
   win*-msvc* {
@@ -33,8 +33,26 @@ CONFIG(debug, debug|release) {
 SOURCES += \
     App/app.cpp \
     Core/controller.cpp \
+    Core/frozen.cpp \
+    Core/heat.cpp \
+    Core/journal.cpp \
+    Core/keyfile.cpp \
     Core/model.cpp \
+    Core/optimal.cpp \
+    Core/overlay.cpp \
+    Core/reclaimer.cpp \
+    Core/snapshot.cpp \
+    Core/tiles.cpp \
+    Core/treelist.cpp \
+    Core/trees.cpp \
     Core/vnode.cpp \
+    Core/workload.cpp \
+    Debug/log.cpp \
+    Debug/perf.cpp \
+    Headless/runner.cpp \
+    Headless/script.cpp \
+    Remote/protocol.cpp \
+    Remote/server.cpp \
     main.cpp \
     App/mainwindow.cpp \
     Core/view.cpp
@@ -42,13 +60,36 @@ SOURCES += \
 HEADERS += \
     App/app.h \
     Core/controller.h \
+    Core/frame.h \
+    Core/frozen.h \
+    Core/heat.h \
+    Core/journal.h \
+    Core/keyfile.h \
     App/mainwindow.h \
     Core/model.h \
+    Core/optimal.h \
+    Core/overlay.h \
+    Core/reclaimer.h \
+    Core/snapshot.h \
+    Core/tiles.h \
+    Core/treelist.h \
+    Core/trees.h \
     Common/node.h \
+    Common/policy.h \
+    Common/forest.h \
+    Common/range.h \
+    Common/sequence.h \
     Observer/observer.h \
     Common/query.h \
     Core/view.h \
-    Core/vnode.h
+    Core/vnode.h \
+    Core/workload.h \
+    Debug/log.h \
+    Debug/perf.h \
+    Headless/runner.h \
+    Headless/script.h \
+    Remote/protocol.h \
+    Remote/server.h
 
 FORMS += \
     App/mainwindow.ui
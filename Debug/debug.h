@@ -1,14 +0,0 @@
-#ifndef DEBUG_H
-#define DEBUG_H
-#include <fstream>
-#include <iostream>
-#include <string>
-
-namespace DSViz {
-
-static void WriteLog(const std::string &str);
-static void ClearLog();
-
-} // namespace DSViz
-
-#endif // DEBUG_H
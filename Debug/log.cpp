@@ -0,0 +1,229 @@
+#include "Debug/log.h"
+#include <algorithm>
+#include <cstdio>
+#include <ctime>
+#include <iomanip>
+#include <sstream>
+
+namespace DSViz {
+
+namespace detail {
+
+LogRing::LogRing(uint32_t thread) : buffer_(kCapacity), thread_(thread) {}
+
+bool LogRing::Push(const LogRecord &record) {
+  size_t head = head_.load(std::memory_order_relaxed);
+  if (head - tail_.load(std::memory_order_acquire) == kCapacity) {
+    dropped_.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+  buffer_[head & (kCapacity - 1)] = record;
+  head_.store(head + 1, std::memory_order_release);
+  return true;
+}
+
+bool LogRing::Empty() const {
+  return head_.load(std::memory_order_acquire) ==
+         tail_.load(std::memory_order_relaxed);
+}
+
+size_t LogRing::TakeDropped() {
+  return dropped_.exchange(0, std::memory_order_relaxed);
+}
+
+uint32_t LogRing::Thread() const { return thread_; }
+
+} // namespace detail
+
+namespace {
+
+const char *LevelName(LogLevel level) {
+  switch (level) {
+  case LogLevel::trace:
+    return "trace";
+  case LogLevel::debug:
+    return "debug";
+  case LogLevel::info:
+    return "info ";
+  case LogLevel::warn:
+    return "warn ";
+  case LogLevel::error:
+    return "error";
+  default:
+    return "     ";
+  }
+}
+
+int64_t Now() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+} // namespace
+
+Logger &Logger::Instance() {
+  static Logger logger;
+  return logger;
+}
+
+bool Logger::Start(Options options) {
+  Stop();
+  options_ = std::move(options);
+  file_.open(options_.path, std::ios::app | std::ios::ate);
+  if (!file_) {
+    return false;
+  }
+  written_ = static_cast<size_t>(file_.tellp());
+  start_ = Now();
+
+  // в самом логе время идет от запуска, так что один раз пишу настоящее
+  std::time_t now = std::time(nullptr);
+  std::ostringstream head;
+  head << "=== log started "
+       << std::put_time(std::localtime(&now), "%Y-%m-%d %H:%M:%S") << "\n";
+  file_ << head.str();
+  written_ += head.str().size();
+
+  stop_ = false;
+  running_.store(true, std::memory_order_relaxed);
+  writer_ = std::thread{[this] { run(); }};
+  return true;
+}
+
+void Logger::Stop() {
+  if (!writer_.joinable()) {
+    return;
+  }
+  running_.store(false, std::memory_order_relaxed);
+  {
+    std::lock_guard lock{mutex_};
+    stop_ = true;
+  }
+  wake_.notify_one();
+  writer_.join();
+  file_.close();
+}
+
+bool Logger::Running() const {
+  return running_.load(std::memory_order_relaxed);
+}
+
+Logger::~Logger() { Stop(); }
+
+Logger::LogRing &Logger::ring() {
+  // буфер живет, пока он нужен хотя бы кому-то из двоих: если поток
+  // завершился, поток записи дочитает его и выбросит
+  thread_local std::shared_ptr<LogRing> ring;
+  if (!ring) {
+    std::lock_guard lock{mutex_};
+    ring = std::make_shared<LogRing>(threads_++);
+    rings_.push_back(ring);
+  }
+  return *ring;
+}
+
+void Logger::run() {
+  std::unique_lock lock{mutex_};
+  while (true) {
+    wake_.wait_for(lock, std::chrono::milliseconds(options_.flush_ms),
+                   [this] { return stop_; });
+    bool stop = stop_;
+    lock.unlock();
+    drain();
+    lock.lock();
+    rings_.erase(std::remove_if(rings_.begin(), rings_.end(),
+                                [](const std::shared_ptr<LogRing> &ring) {
+                                  return ring.use_count() == 1 &&
+                                         ring->Empty();
+                                }),
+                 rings_.end());
+    if (stop) {
+      return;
+    }
+  }
+}
+
+void Logger::drain() {
+  std::vector<std::shared_ptr<LogRing>> rings;
+  {
+    std::lock_guard lock{mutex_};
+    rings = rings_;
+  }
+  // внутри буфера записи уже по порядку, а между потоками упорядочиваю по
+  // времени, чтобы в файле было видно, что происходило одновременно
+  std::vector<std::pair<LogRecord, uint32_t>> batch;
+  for (auto &ring : rings) {
+    ring->Drain([&batch, &ring](const LogRecord &record) {
+      batch.emplace_back(record, ring->Thread());
+    });
+  }
+  std::stable_sort(batch.begin(), batch.end(),
+                   [](const auto &lhs, const auto &rhs) {
+                     return lhs.first.time < rhs.first.time;
+                   });
+  for (auto &[record, thread] : batch) {
+    write(record, thread);
+  }
+  for (auto &ring : rings) {
+    if (size_t dropped = ring->TakeDropped()) {
+      LogRecord record;
+      record.time = Now();
+      record.format = "log buffer overflow, {} records dropped";
+      record.level = LogLevel::warn;
+      record.count = 1;
+      record.args[0].integer = static_cast<long long>(dropped);
+      write(record, ring->Thread());
+    }
+  }
+  file_.flush();
+}
+
+void Logger::write(const LogRecord &record, uint32_t thread) {
+  char head[64];
+  std::snprintf(head, sizeof(head), "[%12.6f] %s t%u ",
+                static_cast<double>(record.time - start_) * 1e-9,
+                LevelName(record.level), thread);
+  line_ = head;
+
+  // {} в формате по очереди заменяются аргументами
+  size_t next = 0;
+  for (const char *c = record.format; *c; ++c) {
+    if (c[0] == '{' && c[1] == '}' && next < record.count) {
+      auto &arg = record.args[next++];
+      char number[32];
+      if (arg.real) {
+        std::snprintf(number, sizeof(number), "%g", arg.number);
+      } else {
+        std::snprintf(number, sizeof(number), "%lld", arg.integer);
+      }
+      line_ += number;
+      ++c;
+    } else {
+      line_ += *c;
+    }
+  }
+  line_ += '\n';
+
+  file_ << line_;
+  written_ += line_.size();
+  if (written_ >= options_.max_bytes) {
+    rotate();
+  }
+}
+
+void Logger::rotate() {
+  file_.close();
+  auto name = [this](int k) {
+    return k == 0 ? options_.path : options_.path + "." + std::to_string(k);
+  };
+  // на винде rename не перезаписывает существующий файл
+  std::remove(name(options_.max_files).c_str());
+  for (int k = options_.max_files - 1; k >= 0; --k) {
+    std::rename(name(k).c_str(), name(k + 1).c_str());
+  }
+  file_.open(options_.path, std::ios::trunc);
+  written_ = 0;
+}
+
+} // namespace DSViz
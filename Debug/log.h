@@ -0,0 +1,184 @@
+#ifndef LOG_H
+#define LOG_H
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// уровень задается при сборке (DEFINES += DSVIZ_LOG_LEVEL=0), все что ниже
+// него вырезается компилятором вместе с вычислением аргументов
+#ifndef DSVIZ_LOG_LEVEL
+#define DSVIZ_LOG_LEVEL 2
+#endif
+
+// DSVIZ_LOG(debug, "split {} at {}", id, key)
+#define DSVIZ_LOG(level, ...)                                                  \
+  do {                                                                         \
+    if constexpr (::DSViz::LogLevel::level >= ::DSViz::kLogLevel) {            \
+      ::DSViz::Logger::Instance().Write(::DSViz::LogLevel::level,              \
+                                        __VA_ARGS__);                          \
+    }                                                                          \
+  } while (false)
+
+namespace DSViz {
+
+enum class LogLevel { trace, debug, info, warn, error, off };
+
+constexpr const LogLevel kLogLevel = static_cast<LogLevel>(DSVIZ_LOG_LEVEL);
+
+namespace detail {
+
+// запись лога хранится в двоичном виде: указатель на строковый литерал и
+// числа. Текст собирает поток записи, а не тот, кто логирует
+struct LogRecord {
+  struct Arg {
+    bool real = {};
+    union {
+      long long integer = {};
+      double number;
+    };
+  };
+
+  static constexpr const size_t kMaxArgs = 4;
+
+  int64_t time = {};
+  const char *format = {};
+  LogLevel level = {};
+  uint32_t count = {};
+  std::array<Arg, kMaxArgs> args = {};
+};
+
+// кольцевой буфер одного потока: пишет только он, читает только поток записи,
+// поэтому хватает двух атомарных счетчиков. Если поток записи не успевает,
+// новые записи отбрасываются и считаются
+class LogRing {
+public:
+  explicit LogRing(uint32_t thread);
+
+  bool Push(const LogRecord &record);
+  template <class F> void Drain(F f);
+  bool Empty() const;
+  size_t TakeDropped();
+  uint32_t Thread() const;
+
+  static constexpr const size_t kCapacity = 1 << 11;
+
+private:
+  std::vector<LogRecord> buffer_;
+  alignas(64) std::atomic<size_t> head_ = {};
+  alignas(64) std::atomic<size_t> tail_ = {};
+  std::atomic<size_t> dropped_ = {};
+  uint32_t thread_ = {};
+};
+
+template <class F> void LogRing::Drain(F f) {
+  size_t tail = tail_.load(std::memory_order_relaxed);
+  size_t head = head_.load(std::memory_order_acquire);
+  for (; tail != head; ++tail) {
+    f(buffer_[tail & (kCapacity - 1)]);
+  }
+  tail_.store(tail, std::memory_order_release);
+}
+
+} // namespace detail
+
+// замена WriteLog, который на каждую строку открывал и закрывал log.txt.
+// Логирующий поток только кладет запись в свой буфер, файл пишет отдельный
+// поток раз в flush_ms, а когда файл дорастает до max_bytes, он уходит в
+// log.txt.1, log.txt.1 - в log.txt.2 и так до max_files
+class Logger {
+  using LogRecord = detail::LogRecord;
+  using LogRing = detail::LogRing;
+
+public:
+  struct Options {
+    std::string path = "./log.txt";
+    size_t max_bytes = size_t{16} << 20;
+    int max_files = 3;
+    int flush_ms = 50;
+  };
+
+  static Logger &Instance();
+
+  bool Start(Options options);
+  // дописывает все, что успели залогировать, и останавливает поток записи
+  void Stop();
+  bool Running() const;
+
+  template <class... Args>
+  void Write(LogLevel level, const char *format, Args... args);
+
+  ~Logger();
+
+private:
+  Logger() = default;
+
+  template <class T> static LogRecord::Arg arg(T value);
+
+  LogRing &ring();
+  void run();
+  void drain();
+  void write(const LogRecord &record, uint32_t thread);
+  void rotate();
+
+  Options options_;
+  std::atomic<bool> running_ = {};
+  int64_t start_ = {};
+
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  bool stop_ = {};
+  std::vector<std::shared_ptr<LogRing>> rings_;
+  uint32_t threads_ = {};
+  std::thread writer_;
+
+  // дальше трогает только поток записи
+  std::ofstream file_;
+  size_t written_ = {};
+  std::string line_;
+};
+
+template <class... Args>
+void Logger::Write(LogLevel level, const char *format, Args... args) {
+  static_assert(sizeof...(Args) <= LogRecord::kMaxArgs,
+                "too many log arguments");
+  if (!running_.load(std::memory_order_relaxed)) {
+    return;
+  }
+  LogRecord record;
+  record.time = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now().time_since_epoch())
+                    .count();
+  record.format = format;
+  record.level = level;
+  record.count = sizeof...(Args);
+  size_t i = 0;
+  ((record.args[i++] = arg(args)), ...);
+  ring().Push(record);
+}
+
+template <class T> Logger::LogRecord::Arg Logger::arg(T value) {
+  static_assert(std::is_arithmetic_v<T> || std::is_enum_v<T>,
+                "only numbers can be logged");
+  LogRecord::Arg res;
+  if constexpr (std::is_floating_point_v<T>) {
+    res.real = true;
+    res.number = value;
+  } else {
+    res.integer = static_cast<long long>(value);
+  }
+  return res;
+}
+
+} // namespace DSViz
+
+#endif // LOG_H
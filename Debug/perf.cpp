@@ -0,0 +1,369 @@
+#include "Debug/perf.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+#ifdef __linux__
+#include <cerrno>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace DSViz {
+
+namespace detail {
+
+#ifdef __linux__
+
+namespace {
+
+struct EventConfig {
+  uint32_t type;
+  uint64_t config;
+};
+
+// в порядке PerfGroup::Event
+const EventConfig kConfigs[PerfGroup::kEvents] = {
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D |
+                             (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                             (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+};
+
+constexpr const uint64_t kReadFormat = PERF_FORMAT_GROUP |
+                                       PERF_FORMAT_TOTAL_TIME_ENABLED |
+                                       PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+int OpenEvent(const EventConfig &config, int group) {
+  perf_event_attr attr;
+  std::memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = config.type;
+  attr.config = config.config;
+  attr.read_format = kReadFormat;
+  // группа стартует целиком, когда откроются все
+  attr.disabled = group == -1;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  return static_cast<int>(
+      syscall(SYS_perf_event_open, &attr, 0, -1, group, 0));
+}
+
+} // namespace
+
+PerfGroup::PerfGroup() {
+  fds_.fill(-1);
+  fds_[cycles] = OpenEvent(kConfigs[cycles], -1);
+  if (fds_[cycles] == -1) {
+    if (errno == EACCES || errno == EPERM) {
+      error_ = "no permission, see /proc/sys/kernel/perf_event_paranoid";
+    } else if (errno == ENOENT || errno == EOPNOTSUPP || errno == ENOSYS) {
+      error_ = "not supported by this CPU or kernel";
+    } else {
+      error_ = std::strerror(errno);
+    }
+    return;
+  }
+  for (size_t i = 1; i < kEvents; ++i) {
+    fds_[i] = OpenEvent(kConfigs[i], fds_[cycles]);
+  }
+  ioctl(fds_[cycles], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+  ioctl(fds_[cycles], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+}
+
+PerfGroup::~PerfGroup() {
+  for (int fd : fds_) {
+    if (fd != -1) {
+      close(fd);
+    }
+  }
+}
+
+bool PerfGroup::Read(Values *out) const {
+  out->fill(0);
+  if (!Available()) {
+    return false;
+  }
+  // nr, time_enabled, time_running и значения в порядке открытия
+  uint64_t buffer[3 + kEvents];
+  if (read(fds_[cycles], buffer, sizeof(buffer)) <
+      static_cast<ssize_t>(3 * sizeof(uint64_t))) {
+    return false;
+  }
+  uint64_t enabled = buffer[1], running = buffer[2];
+  double scale = running > 0 && running < enabled
+                     ? static_cast<double>(enabled) / running
+                     : 1.0;
+  size_t next = 0;
+  for (size_t i = 0; i < kEvents && next < buffer[0]; ++i) {
+    if (fds_[i] != -1) {
+      (*out)[i] = static_cast<uint64_t>(buffer[3 + next++] * scale);
+    }
+  }
+  return true;
+}
+
+#else
+
+PerfGroup::PerfGroup() {
+  fds_.fill(-1);
+  error_ = "not supported on this platform";
+}
+
+PerfGroup::~PerfGroup() = default;
+
+bool PerfGroup::Read(Values *out) const {
+  out->fill(0);
+  return false;
+}
+
+#endif
+
+bool PerfGroup::Available() const { return fds_[cycles] != -1; }
+
+bool PerfGroup::Has(Event event) const { return fds_[event] != -1; }
+
+const std::string &PerfGroup::Error() const { return error_; }
+
+} // namespace detail
+
+namespace {
+
+using Sample = Profiler::Sample;
+
+Sample Plus(Sample a, const Sample &b) {
+  for (size_t i = 0; i < a.events.size(); ++i) {
+    a.events[i] += b.events[i];
+  }
+  a.ns += b.ns;
+  return a;
+}
+
+// счетчики только растут, а цена чтения может оказаться больше замера
+Sample Minus(Sample a, const Sample &b) {
+  for (size_t i = 0; i < a.events.size(); ++i) {
+    a.events[i] = a.events[i] > b.events[i] ? a.events[i] - b.events[i] : 0;
+  }
+  a.ns = std::max<int64_t>(a.ns - b.ns, 0);
+  return a;
+}
+
+// как в сценариях
+const char *QueryName(QueryType type) {
+  switch (type) {
+  case QueryType::insert:
+    return "insert";
+  case QueryType::remove:
+    return "remove";
+  case QueryType::find:
+    return "find";
+  case QueryType::split:
+    return "split";
+  case QueryType::merge:
+    return "merge";
+  case QueryType::deltree:
+    return "deltree";
+  case QueryType::batch:
+    return "batch";
+  case QueryType::undo:
+    return "undo";
+  case QueryType::redo:
+    return "redo";
+  case QueryType::freeze:
+    return "freeze";
+  case QueryType::policy:
+    return "policy";
+  case QueryType::seq_make:
+    return "seq make";
+  case QueryType::seq_insert:
+    return "seq insert";
+  case QueryType::seq_erase:
+    return "seq erase";
+  case QueryType::seq_split:
+    return "seq split";
+  case QueryType::seq_reverse:
+    return "seq reverse";
+  case QueryType::seq_add:
+    return "seq add";
+  case QueryType::link:
+    return "link";
+  case QueryType::cut:
+    return "cut";
+  case QueryType::find_root:
+    return "root";
+  case QueryType::connected:
+    return "connected";
+  case QueryType::path:
+    return "path";
+  case QueryType::peek:
+    return "peek";
+  case QueryType::range_extract:
+    return "extract";
+  case QueryType::range_erase:
+    return "erase";
+  case QueryType::lower_bound:
+    return "lower";
+  case QueryType::upper_bound:
+    return "upper";
+  case QueryType::successor:
+    return "succ";
+  case QueryType::predecessor:
+    return "pred";
+  case QueryType::load:
+    return "load";
+  case QueryType::trace:
+    return "trace";
+  case QueryType::optimal:
+    return "optimal";
+  case QueryType::heat:
+    return "heat";
+  case QueryType::heat_map:
+    return "heatmap";
+  default:
+    return "?";
+  }
+}
+
+} // namespace
+
+Profiler::Profiler(Options options) : options_{options} {
+  last_ = read();
+  // цена пары чтений: берется самый дешевый из нескольких пустых замеров
+  for (int i = 0; i < 16; ++i) {
+    auto start = Now();
+    auto cost = Minus(Now(), start);
+    if (i == 0 || cost.events[PerfGroup::cycles] <
+                      overhead_.events[PerfGroup::cycles] ||
+        (!Hardware() && cost.ns < overhead_.ns)) {
+      overhead_ = cost;
+    }
+  }
+}
+
+bool Profiler::Hardware() const { return group_.Available(); }
+
+const std::string &Profiler::Error() const { return group_.Error(); }
+
+bool Profiler::Splays() const { return options_.splays; }
+
+Profiler::Sample Profiler::read() {
+  Sample sample;
+  group_.Read(&sample.events);
+  sample.ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                  std::chrono::steady_clock::now().time_since_epoch())
+                  .count();
+  return sample;
+}
+
+Profiler::Sample Profiler::Now() {
+  if (paused_ > 0) {
+    return counted_;
+  }
+  return Plus(counted_, Minus(read(), last_));
+}
+
+void Profiler::Pause() {
+  if (paused_++ == 0) {
+    counted_ = Plus(counted_, Minus(read(), last_));
+  }
+}
+
+void Profiler::Resume() {
+  if (--paused_ == 0) {
+    last_ = read();
+  }
+}
+
+void Profiler::Add(QueryType type, const Sample &start, long long rotations) {
+  auto index = static_cast<size_t>(type);
+  if (index < rows_.size()) {
+    add(&rows_[index], start, rotations);
+  }
+}
+
+void Profiler::AddSplay(const Sample &start, long long rotations) {
+  add(&splays_, start, rotations);
+}
+
+void Profiler::add(Row *row, const Sample &start, long long rotations) {
+  ++row->count;
+  row->rotations += rotations;
+  row->total = Plus(row->total, Minus(Minus(Now(), start), overhead_));
+}
+
+std::string Profiler::Report() const {
+  std::string res;
+  if (!Hardware()) {
+    res += "hardware counters unavailable (" + Error() +
+           "), only time and rotations\n";
+  }
+  char cell[64];
+  auto column = [&](const char *text) {
+    std::snprintf(cell, sizeof(cell), "%12s", text);
+    res += cell;
+  };
+  // среднее value / by, если событие есть
+  auto ratio = [&](bool has, double value, long long by, const char *format) {
+    if (!has || by == 0) {
+      column("-");
+      return;
+    }
+    char text[32];
+    std::snprintf(text, sizeof(text), format, value / by);
+    column(text);
+  };
+
+  std::snprintf(cell, sizeof(cell), "%-12s", "operation");
+  res += cell;
+  for (auto name : {"count", "ns/op", "cycles/op", "instr/op", "IPC",
+                    "L1d miss/op", "LLC miss/op", "br miss/op", "rot/op",
+                    "L1d/rot", "LLC/rot"}) {
+    column(name);
+  }
+  res += "\n";
+
+  auto line = [&](const char *name, const Row &row) {
+    if (row.count == 0) {
+      return;
+    }
+    auto &events = row.total.events;
+    auto has = [&](PerfGroup::Event event) { return group_.Has(event); };
+    std::snprintf(cell, sizeof(cell), "%-12s", name);
+    res += cell;
+    std::snprintf(cell, sizeof(cell), "%12lld", row.count);
+    res += cell;
+    ratio(true, static_cast<double>(row.total.ns), row.count, "%.0f");
+    ratio(has(PerfGroup::cycles), events[PerfGroup::cycles], row.count,
+          "%.0f");
+    ratio(has(PerfGroup::instructions), events[PerfGroup::instructions],
+          row.count, "%.0f");
+    ratio(has(PerfGroup::instructions) && events[PerfGroup::cycles] > 0,
+          events[PerfGroup::instructions],
+          static_cast<long long>(events[PerfGroup::cycles]), "%.2f");
+    ratio(has(PerfGroup::l1_misses), events[PerfGroup::l1_misses], row.count,
+          "%.1f");
+    ratio(has(PerfGroup::llc_misses), events[PerfGroup::llc_misses],
+          row.count, "%.1f");
+    ratio(has(PerfGroup::branch_misses), events[PerfGroup::branch_misses],
+          row.count, "%.1f");
+    ratio(true, static_cast<double>(row.rotations), row.count, "%.1f");
+    ratio(has(PerfGroup::l1_misses), events[PerfGroup::l1_misses],
+          row.rotations, "%.2f");
+    ratio(has(PerfGroup::llc_misses), events[PerfGroup::llc_misses],
+          row.rotations, "%.2f");
+    res += "\n";
+  };
+  for (size_t i = 0; i < rows_.size(); ++i) {
+    line(QueryName(static_cast<QueryType>(i)), rows_[i]);
+  }
+  line("(splay)", splays_);
+  return res;
+}
+
+} // namespace DSViz
@@ -0,0 +1,112 @@
+#ifndef PERF_H
+#define PERF_H
+#include "Common/query.h"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace DSViz {
+
+namespace detail {
+
+// группа аппаратных счетчиков процессора через perf_event_open (только
+// linux). Считается только пользовательский код вызывающего потока. Счетчики
+// открываются одной группой, чтобы процессор включал и выключал их вместе;
+// если какое-то событие процессор не умеет (например LLC на виртуалке), оно
+// просто пропускается. На других системах и без прав (perf_event_paranoid)
+// группа пустая
+class PerfGroup {
+public:
+  enum Event { cycles, instructions, l1_misses, llc_misses, branch_misses };
+  static constexpr const size_t kEvents = 5;
+  using Values = std::array<uint64_t, kEvents>;
+
+  PerfGroup();
+  ~PerfGroup();
+
+  PerfGroup(const PerfGroup &) = delete;
+  PerfGroup &operator=(const PerfGroup &) = delete;
+
+  // открылись хотя бы такты
+  bool Available() const;
+  bool Has(Event event) const;
+  // почему счетчиков нет
+  const std::string &Error() const;
+  // значения с момента открытия. Если группу вытесняли другие счетчики,
+  // значения растянуты на все время пропорционально
+  bool Read(Values *out) const;
+
+private:
+  std::array<int, kEvents> fds_;
+  std::string error_;
+};
+
+} // namespace detail
+
+// профилировщик операций модели: на каждую операцию (Controller::Execute) и,
+// если попросить, на каждый splay снимает счетчики PerfGroup, время и число
+// поворотов и копит их по типу запроса. Кадры в счет не идут: пока модель
+// отправляет кадр (а View его рисует или runner копирует), счет стоит на
+// паузе. Без аппаратных счетчиков остаются время и повороты.
+//
+// Чтение счетчиков - системный вызов, поэтому его собственная цена (она
+// меряется при создании) вычитается из каждого замера. Для коротких операций
+// на маленьком дереве смысл имеют только средние по многим операциям
+class Profiler {
+  using PerfGroup = detail::PerfGroup;
+
+public:
+  struct Options {
+    // отдельная строка на каждый splay (внутри операций)
+    bool splays = false;
+  };
+
+  struct Sample {
+    PerfGroup::Values events = {};
+    int64_t ns = {};
+  };
+
+  explicit Profiler(Options options);
+
+  bool Hardware() const;
+  const std::string &Error() const;
+  bool Splays() const;
+
+  // счет с начала, без пауз
+  Sample Now();
+  void Pause();
+  void Resume();
+
+  // замер от start до сейчас идет в строку type
+  void Add(QueryType type, const Sample &start, long long rotations);
+  void AddSplay(const Sample &start, long long rotations);
+
+  // таблица: средние на операцию и промахи кэша на поворот
+  std::string Report() const;
+
+private:
+  struct Row {
+    long long count = {};
+    long long rotations = {};
+    Sample total = {};
+  };
+
+  void add(Row *row, const Sample &start, long long rotations);
+  Sample read();
+
+  Options options_;
+  PerfGroup group_;
+  // сумма отрезков без пауз к моменту last_
+  Sample counted_ = {};
+  Sample last_ = {};
+  int paused_ = {};
+  Sample overhead_ = {};
+  // индекс - QueryType
+  std::array<Row, static_cast<size_t>(QueryType::do_nothing)> rows_ = {};
+  Row splays_ = {};
+};
+
+} // namespace DSViz
+
+#endif // PERF_H
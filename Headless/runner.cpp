@@ -0,0 +1,296 @@
+#include "Headless/runner.h"
+#include "Headless/script.h"
+#include "Core/view.h"
+#include "Debug/log.h"
+#include <QCommandLineParser>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QImage>
+#include <QSvgGenerator>
+#include <QThreadPool>
+#include <QtConcurrent>
+#include <climits>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+namespace DSViz {
+
+auto HeadlessRunner::GetCallback() {
+  return [this](const MsgType &msg) {
+    HandleMsg(msg.code, msg.trees, msg.results, msg.values, msg.overlay,
+              msg.heat);
+  };
+}
+
+HeadlessRunner::HeadlessRunner(Options options)
+    : options_{std::move(options)}, controller_{&model_},
+      port_in_{GetCallback()} {
+  if (options_.compact) {
+    layout_.SetLayout(ReadyTree::Layout::tidy);
+  }
+  if (options_.threads > 0) {
+    QThreadPool::globalInstance()->setMaxThreadCount(options_.threads);
+  }
+  if (options_.profile || options_.profile_splays) {
+    profiler_ = std::make_unique<Profiler>(
+        Profiler::Options{options_.profile_splays});
+    model_.SetProfiler(profiler_.get());
+  }
+  if (options_.no_undo) {
+    model_.SetUndoLimit(0);
+  }
+  if (options_.heat) {
+    model_.EnableHeat(true);
+  }
+  // как и во View: сначала кладу пустой запрос, чтобы контроллер при подписке
+  // ничего не выполнил
+  port_out_.Set(UserQuery{QueryType::do_nothing, {0, 0}});
+  port_out_.Subscribe(controller_.GetPortIn());
+  model_.SubscribeToBareTree(&port_in_);
+}
+
+int HeadlessRunner::Run() {
+  std::ifstream in{options_.script.toStdString()};
+  if (!in) {
+    std::cerr << "Can't open script " << options_.script.toStdString()
+              << "\n";
+    return 1;
+  }
+  std::vector<Script::Step> steps;
+  int bad_line = 0;
+  if (!Script::Parse(in, &steps, &bad_line)) {
+    std::cerr << "Script error at line " << bad_line << "\n";
+    return 1;
+  }
+  if (!QDir{}.mkpath(options_.out_dir)) {
+    std::cerr << "Can't create " << options_.out_dir.toStdString() << "\n";
+    return 1;
+  }
+
+  for (auto &step : steps) {
+    if (step.is_dump) {
+      Dump(step.query.args.first, step.query.args.second);
+      continue;
+    }
+    if (step.is_load) {
+      Load(step.query.args.first, step.path, step.format);
+      continue;
+    }
+    if (!step.is_workload) {
+      Execute(step.query);
+      continue;
+    }
+    Workload workload{step.workload};
+    UserQuery query;
+    while (workload.Next(*trees_, &query)) {
+      Execute(query);
+    }
+  }
+  Flush();
+
+  for (int id = 0; id < trees_->Capacity(); ++id) {
+    auto stats = model_.Stats(id);
+    if (trees_->Contains(id) && stats.finds > 0) {
+      std::cout << "tree " << id << ": " << detail::Text::SplaySummary(stats)
+                << "\n";
+    }
+  }
+  for (int id = 0; options_.heat && id < trees_->Capacity(); ++id) {
+    if (!trees_->Contains(id)) {
+      continue;
+    }
+    int height = -1;
+    auto top = heat_->Top((*trees_)[id], kHotKeys, &height);
+    if (top.empty()) {
+      continue;
+    }
+    std::cout << "tree " << id << " hot keys (height " << height << "):";
+    for (auto &hot : top) {
+      std::cout << " " << hot.key << " (" << hot.heat << ", depth "
+                << hot.depth << ")";
+    }
+    std::cout << "\n";
+  }
+  if (profiler_) {
+    std::cout << profiler_->Report();
+  }
+  std::cout << frame_ << " frames, " << saved_ << " saved to "
+            << options_.out_dir.toStdString() << "\n";
+  return failed_ ? 1 : 0;
+}
+
+bool HeadlessRunner::Requested(int argc, char *argv[]) {
+  for (int i = 1; i < argc; ++i) {
+    if (std::strcmp(argv[i], "--export") == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool HeadlessRunner::ParseOptions(const QStringList &args, Options *options) {
+  QCommandLineParser parser;
+  parser.setApplicationDescription("DSViz headless export");
+  parser.addHelpOption();
+  parser.addOptions({
+      {"export", "Operation script to run.", "script"},
+      {"out", "Output directory.", "dir", "."},
+      {"format", "Frame format: png or svg.", "format", "png"},
+      {"every", "Save every k-th frame.", "k", "1"},
+      {"threads", "Number of render threads.", "n", "0"},
+      {"compact", "Use the compact tree layout."},
+      {"profile", "Count CPU events per operation."},
+      {"profile-splay", "Count CPU events per operation and per splay."},
+      {"heat", "Color frames by access counts, print the hottest keys."},
+      {"no-undo", "Keep no undo history."},
+  });
+  parser.process(args);
+
+  options->script = parser.value("export");
+  options->out_dir = parser.value("out");
+  options->format = parser.value("format").toLower();
+  options->compact = parser.isSet("compact");
+  options->profile = parser.isSet("profile");
+  options->profile_splays = parser.isSet("profile-splay");
+  options->heat = parser.isSet("heat");
+  options->no_undo = parser.isSet("no-undo");
+  bool every_ok{}, threads_ok{};
+  options->every = parser.value("every").toInt(&every_ok);
+  options->threads = parser.value("threads").toInt(&threads_ok);
+  if (!every_ok || options->every < 1 || !threads_ok ||
+      (options->format != "png" && options->format != "svg")) {
+    std::cerr << parser.helpText().toStdString();
+    return false;
+  }
+  return true;
+}
+
+void HeadlessRunner::Execute(const UserQuery &query) {
+  // рисую то дерево, над которым выполняется операция (для merge - левое,
+  // к нему приливается правое, для пакета - дерево первого запроса)
+  target_id_ = query.args.first;
+  if (query.type == QueryType::batch && !query.batch.empty()) {
+    target_id_ = query.batch.front().args.first;
+  }
+  forest_ = IsForestQuery(query.type) ||
+            (query.type == QueryType::batch && !query.batch.empty() &&
+             IsForestQuery(query.batch.front().type));
+  port_out_.Set(query);
+}
+
+void HeadlessRunner::Load(int id, const std::string &path,
+                          KeyFile::Format format) {
+  KeyFile::Result result;
+  QElapsedTimer timer;
+  timer.start();
+  if (!KeyFile::Read(QString::fromStdString(path), format, &result)) {
+    std::cerr << path << ": " << result.error << "\n";
+    failed_ = true;
+    return;
+  }
+  std::cout << path << ": " << result.read << " keys read, "
+            << result.keys.size() << " unique, " << timer.elapsed()
+            << " ms\n";
+  UserQuery query{QueryType::load, {id, 0}};
+  query.keys = std::make_shared<const std::vector<int>>(std::move(result.keys));
+  Execute(query);
+}
+
+void HeadlessRunner::Dump(int id, bool splay) {
+  // trees_ есть с самого начала: подписка сразу отдает последний кадр модели
+  if (!trees_->Contains(id)) {
+    std::cout << detail::Text::GetMsg(MsgCode::wrong_id) << "\n";
+    return;
+  }
+  std::cout << "tree " << id << ":";
+  auto cursor = model_.Scan(id, INT_MIN, splay);
+  std::vector<int> keys(kDumpChunk);
+  while (size_t count = cursor.Next(keys.data(), keys.size())) {
+    for (size_t i = 0; i < count; ++i) {
+      std::cout << " " << keys[i];
+    }
+  }
+  std::cout << "\n";
+}
+
+void HeadlessRunner::HandleMsg(MsgCode code, const Trees *trees,
+                               const std::vector<MsgCode> &results,
+                               const std::vector<int> &values,
+                               const detail::Overlay *overlay,
+                               const detail::HeatClock *heat) {
+  trees_ = trees;
+  heat_ = heat;
+  if (code == MsgCode::empty_msg) {
+    return;
+  }
+  if (code == MsgCode::batch_done) {
+    std::cout << detail::Text::GetMsg(code)
+              << detail::Text::BatchSummary(results) << "\n";
+  }
+  if (code == MsgCode::forest_root || code == MsgCode::path_done ||
+      code == MsgCode::extract_done || code == MsgCode::erase_done ||
+      code == MsgCode::neighbour || code == MsgCode::load_done ||
+      code == MsgCode::trace_off || code == MsgCode::optimal_done) {
+    std::cout << detail::Text::Answer(code, values) << "\n";
+  }
+  // load в новое дерево: его id становится известен только из ответа
+  if (code == MsgCode::load_done && !values.empty()) {
+    target_id_ = values[0];
+  }
+  if (frame_++ % options_.every != 0) {
+    return;
+  }
+  // после deltree дерева уже может не быть, тогда кадр будет пустым
+  int id = forest_ ? model_.ForestId() : target_id_;
+  layout_.Fill(trees->Contains(id) ? (*trees)[id] : nullptr);
+  pending_.emplace_back(
+      frame_ - 1,
+      Snapshot{layout_.Get(), code, overlay, options_.heat ? heat : nullptr});
+  if (pending_.size() >= kBatchSize) {
+    Flush();
+  }
+}
+
+void HeadlessRunner::Flush() {
+  QElapsedTimer timer;
+  timer.start();
+  QtConcurrent::blockingMap(pending_, [this](std::pair<int, Snapshot> &item) {
+    if (!Save(item.second, item.first)) {
+      failed_ = true;
+    }
+  });
+  saved_ += static_cast<int>(pending_.size());
+  DSVIZ_LOG(info, "saved {} frames in {} ms", pending_.size(),
+            timer.elapsed());
+  pending_.clear();
+}
+
+bool HeadlessRunner::Save(const Snapshot &snapshot, int frame) const {
+  QRectF bounds = snapshot.Bounds();
+  int width = bounds.width() * Snapshot::kPixelsPerUnit + 2 * Snapshot::kMargin;
+  int height =
+      bounds.height() * Snapshot::kPixelsPerUnit + 2 * Snapshot::kMargin;
+  width = std::min(width, kMaxSide);
+  height = std::min(height, kMaxSide);
+  QString path = QDir{options_.out_dir}.filePath(
+      QString("frame_%1.%2").arg(frame, 6, 10, QChar('0')).arg(options_.format));
+
+  if (options_.format == "svg") {
+    QSvgGenerator svg;
+    svg.setFileName(path);
+    svg.setSize(QSize{width, height});
+    svg.setViewBox(QRect{0, 0, width, height});
+    QPainter painter{&svg};
+    snapshot.Render(&painter, QRectF{0, 0, double(width), double(height)});
+    return painter.end();
+  }
+
+  QImage image{width, height, QImage::Format_ARGB32_Premultiplied};
+  QPainter painter{&image};
+  snapshot.Render(&painter, QRectF{0, 0, double(width), double(height)});
+  painter.end();
+  return image.save(path);
+}
+
+} // namespace DSViz
@@ -0,0 +1,99 @@
+#ifndef RUNNER_H
+#define RUNNER_H
+#include "Common/query.h"
+#include "Core/controller.h"
+#include "Core/keyfile.h"
+#include "Core/model.h"
+#include "Core/snapshot.h"
+#include "Core/vnode.h"
+#include "Debug/perf.h"
+#include "Observer/observer.h"
+#include <QString>
+#include <atomic>
+#include <memory>
+#include <string>
+
+namespace DSViz {
+
+// headless режим: прогоняет сценарий через Model и сохраняет кадры анимации в
+// картинки, без окна и без задержек между кадрами. Кадры копируются в
+// Snapshot, а растеризуются пачками параллельно на пуле потоков
+class HeadlessRunner {
+  using ReadyTree = detail::ReadyTree;
+  using Trees = detail::Trees;
+  using MsgType = Frame;
+  using UserQuery = UserQuery<int>;
+
+  auto GetCallback();
+
+public:
+  struct Options {
+    QString script;
+    QString out_dir = ".";
+    QString format = "png";
+    // сохраняется каждый every-й кадр
+    int every = 1;
+    // 0 - столько потоков, сколько ядер
+    int threads = 0;
+    bool compact = false;
+    // счетчики процессора по операциям (и по каждому splay), таблица
+    // печатается в конце
+    bool profile = false;
+    bool profile_splays = false;
+    // кадры раскрашиваются по весу вершин, а в конце печатаются самые
+    // горячие ключи деревьев
+    bool heat = false;
+    // история undo не ведется: длинный сценарий не держит в памяти старые
+    // значения вершин, а журнал ничего не стоит
+    bool no_undo = false;
+  };
+
+  explicit HeadlessRunner(Options options);
+
+  int Run();
+
+  // есть ли среди аргументов --export, проверяется до создания QApplication,
+  // чтобы успеть выбрать offscreen платформу
+  static bool Requested(int argc, char *argv[]);
+  static bool ParseOptions(const QStringList &args, Options *options);
+
+  static constexpr const int kBatchSize = 256;
+  static constexpr const int kMaxSide = 8192;
+  static constexpr const size_t kDumpChunk = 4096;
+  static constexpr const size_t kHotKeys = 10;
+
+private:
+  void HandleMsg(MsgCode code, const Trees *trees,
+                 const std::vector<MsgCode> &results,
+                 const std::vector<int> &values,
+                 const detail::Overlay *overlay,
+                 const detail::HeatClock *heat);
+  void Execute(const UserQuery &query);
+  // читает ключи из файла и отправляет их в дерево id (-1 - в новое)
+  void Load(int id, const std::string &path, KeyFile::Format format);
+  // печатает ключи дерева курсором модели, порциями по kDumpChunk
+  void Dump(int id, bool splay);
+  void Flush();
+  bool Save(const Snapshot &snapshot, int frame) const;
+
+  Options options_;
+  std::unique_ptr<Profiler> profiler_;
+  Model model_ = {};
+  Controller controller_;
+  ReadyTree layout_ = {};
+  std::vector<std::pair<int, Snapshot>> pending_;
+  std::atomic<bool> failed_ = {};
+  int frame_ = {};
+  int saved_ = {};
+  int target_id_ = {};
+  // запросы к лесу адресуются вершинам, рисуется слот леса
+  bool forest_ = {};
+  const Trees *trees_ = {};
+  const detail::HeatClock *heat_ = {};
+
+  Observer<MsgType> port_in_;
+  Observable<UserQuery> port_out_;
+};
+
+} // namespace DSViz
+#endif // RUNNER_H
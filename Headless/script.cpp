@@ -0,0 +1,225 @@
+#include "Headless/script.h"
+#include "Common/forest.h"
+#include "Common/range.h"
+#include "Common/sequence.h"
+#include <map>
+#include <sstream>
+#include <string>
+
+namespace DSViz {
+
+bool Script::Parse(std::istream &in, std::vector<Step> *steps,
+                   int *bad_line) {
+  std::string line;
+  int line_no = 0;
+  bool in_batch = false;
+  while (std::getline(in, line)) {
+    ++line_no;
+    if (!ParseLine(line, steps, &in_batch)) {
+      if (bad_line) {
+        *bad_line = line_no;
+      }
+      return false;
+    }
+  }
+  // незакрытый begin
+  if (in_batch && bad_line) {
+    *bad_line = line_no;
+  }
+  return !in_batch;
+}
+
+bool Script::ParseLine(const std::string &line, std::vector<Step> *steps,
+                       bool *in_batch) {
+  static const std::map<std::string, QueryType> kCommands = {
+      {"insert", QueryType::insert}, {"remove", QueryType::remove},
+      {"find", QueryType::find},     {"peek", QueryType::peek},
+      {"split", QueryType::split},   {"merge", QueryType::merge},
+      {"deltree", QueryType::deltree}, {"freeze", QueryType::freeze},
+      {"lower", QueryType::lower_bound}, {"upper", QueryType::upper_bound},
+      {"succ", QueryType::successor},  {"pred", QueryType::predecessor},
+      {"optimal", QueryType::optimal}};
+
+  std::istringstream stream{line};
+  std::string cmd;
+  if (!(stream >> cmd) || cmd.front() == '#') {
+    return true;
+  }
+  if (cmd == "begin") {
+    UserQuery batch{QueryType::batch, {0, 0}};
+    // число после begin необязательное: какой по счету кадр сохранять
+    if (!(stream >> batch.sample) && !stream.eof()) {
+      return false;
+    }
+    if (*in_batch) {
+      return false;
+    }
+    steps->push_back(Step{batch});
+    *in_batch = true;
+    return true;
+  }
+  if (cmd == "end") {
+    bool was_in_batch = *in_batch;
+    *in_batch = false;
+    return was_in_batch;
+  }
+  // генератору нужно состояние деревьев между запросами, а пакет выполняется
+  // целиком, так что внутри begin/end gen не разрешен
+  if (cmd == "gen" && *in_batch) {
+    return false;
+  }
+  if (cmd == "gen") {
+    std::string spec;
+    std::getline(stream, spec);
+    Step step{UserQuery{QueryType::do_nothing, {0, 0}}, true};
+    if (!Workload::Parse(spec, &step.workload)) {
+      return false;
+    }
+    if (step.workload.tree_id == -1) {
+      step.workload.tree_id = 0;
+    }
+    steps->push_back(step);
+    return true;
+  }
+  if (cmd == "policy") {
+    UserQuery query{QueryType::policy, {0, 0}};
+    std::string spec;
+    if (!(stream >> query.args.first)) {
+      return false;
+    }
+    std::getline(stream, spec);
+    if (!SplayPolicy::Parse(spec, &query.policy)) {
+      return false;
+    }
+    Push(query, steps, *in_batch);
+    return true;
+  }
+  if (cmd == "seq") {
+    UserQuery query{QueryType::do_nothing, {0, 0}};
+    int id{};
+    std::string spec;
+    if (!(stream >> id)) {
+      return false;
+    }
+    std::getline(stream, spec);
+    if (!ParseSequenceQuery(spec, id, &query)) {
+      return false;
+    }
+    Push(query, steps, *in_batch);
+    return true;
+  }
+  if (cmd == "range") {
+    UserQuery query{QueryType::do_nothing, {0, 0}};
+    int id{};
+    std::string spec;
+    if (!(stream >> id)) {
+      return false;
+    }
+    std::getline(stream, spec);
+    if (!ParseRangeQuery(spec, id, &query)) {
+      return false;
+    }
+    Push(query, steps, *in_batch);
+    return true;
+  }
+  if (cmd == "dump") {
+    Step step{UserQuery{QueryType::do_nothing, {0, 0}}};
+    step.is_dump = true;
+    std::string mode;
+    if (*in_batch || !(stream >> step.query.args.first)) {
+      return false;
+    }
+    if (stream >> mode && mode.front() != '#') {
+      if (mode != "splay") {
+        return false;
+      }
+      step.query.args.second = 1;
+    }
+    steps->push_back(step);
+    return true;
+  }
+  if (cmd == "trace") {
+    UserQuery query{QueryType::trace, {0, 0}};
+    std::string mode;
+    if (!(stream >> query.args.first >> mode) ||
+        (mode != "on" && mode != "off")) {
+      return false;
+    }
+    query.args.second = mode == "on";
+    Push(query, steps, *in_batch);
+    return true;
+  }
+  if (cmd == "load") {
+    Step step{UserQuery{QueryType::load, {-1, 0}}};
+    step.is_load = true;
+    std::string id, format;
+    if (*in_batch || !(stream >> id >> step.path)) {
+      return false;
+    }
+    if (id != "new") {
+      std::istringstream id_stream{id};
+      if (!(id_stream >> step.query.args.first) || !id_stream.eof()) {
+        return false;
+      }
+    }
+    if (stream >> format && format.front() != '#' &&
+        !KeyFile::ParseFormat(format, &step.format)) {
+      return false;
+    }
+    steps->push_back(step);
+    return true;
+  }
+  if (cmd == "heat") {
+    UserQuery query{QueryType::heat, {0, 0}};
+    if (!(stream >> query.args.second) || query.args.second < 0) {
+      return false;
+    }
+    Push(query, steps, *in_batch);
+    return true;
+  }
+  if (cmd == "undo" || cmd == "redo") {
+    UserQuery query{cmd == "undo" ? QueryType::undo : QueryType::redo, {0, 0}};
+    if (*in_batch) {
+      return false;
+    }
+    steps->push_back(Step{query});
+    return true;
+  }
+  UserQuery forest{QueryType::do_nothing, {0, 0}};
+  if (ParseForestQuery(line, &forest)) {
+    // кадры сценария сохраняются все, так что и лес с анимацией
+    forest.animate = true;
+    Push(forest, steps, *in_batch);
+    return true;
+  }
+  auto it = kCommands.find(cmd);
+  if (it == kCommands.end()) {
+    return false;
+  }
+
+  UserQuery query{it->second, {0, 0}};
+  if (!(stream >> query.args.first)) {
+    return false;
+  }
+  if (query.type != QueryType::deltree && query.type != QueryType::freeze &&
+      query.type != QueryType::optimal && !(stream >> query.args.second)) {
+    return false;
+  }
+  std::string rest;
+  if (stream >> rest && rest.front() != '#') {
+    return false;
+  }
+  Push(query, steps, *in_batch);
+  return true;
+}
+
+void Script::Push(const UserQuery &query, std::vector<Step> *steps,
+                  bool in_batch) {
+  if (in_batch) {
+    steps->back().query.batch.push_back(query);
+  } else {
+    steps->push_back(Step{query});
+  }
+}
+
+} // namespace DSViz
@@ -0,0 +1,74 @@
+#ifndef SCRIPT_H
+#define SCRIPT_H
+#include "Common/query.h"
+#include "Core/keyfile.h"
+#include "Core/workload.h"
+#include <istream>
+#include <string>
+#include <vector>
+
+namespace DSViz {
+
+// сценарий операций для headless режима. Одна операция на строку:
+//
+//   insert <tree id> <key>
+//   remove <tree id> <key>
+//   find <tree id> <key>
+//   peek <tree id> <key>   (find без splay)
+//   lower | upper | succ | pred <tree id> <key>   (соседний ключ)
+//   split <tree id> <key>
+//   merge <left tree id> <right tree id>
+//   deltree <tree id>
+//   freeze <tree id>
+//   policy <tree id> full | semi | depth <k> | random <p>
+//   seq <tree id> <команда последовательности, см. ParseSequenceQuery>
+//   range <tree id> extract | erase <l> <r>
+//   dump <tree id> [splay]   (печатает ключи дерева по возрастанию)
+//   load <tree id> | new <путь> [text | binary | guess]   (ключи из файла)
+//   trace <tree id> on | off   (запись поисков)
+//   optimal <tree id>   (статическое дерево по записи, см. Model::BuildOptimal)
+//   heat <k>   (счетчики обращений затухают вдвое за k обращений, 0 - нет)
+//   link | cut | root | connected | path <вершины, см. ParseForestQuery>
+//   undo
+//   redo
+//   gen <описание нагрузки, см. Workload>
+//   begin [k] ... end
+//
+// запросы между begin и end выполняются одной пакетной командой, из
+// промежуточных кадров сохраняется только каждый k-й (по умолчанию никакой).
+//
+// пустые строки и строки, начинающиеся с #, пропускаются. Если у gen не
+// указан tree, нагрузка идет в дерево 0
+class Script {
+  using UserQuery = UserQuery<int>;
+
+public:
+  // либо одиночный запрос, либо генератор нагрузки
+  struct Step {
+    UserQuery query;
+    bool is_workload = false;
+    Workload::Params workload = {};
+    // dump: id дерева в query.args.first, со splay ли обход - в args.second
+    bool is_dump = false;
+    // load: дерево в query.args.first (-1 - новое), сами ключи читаются
+    // только при выполнении
+    bool is_load = false;
+    std::string path = {};
+    KeyFile::Format format = KeyFile::Format::guess;
+  };
+
+  // возвращает false и номер первой некорректной строки, если разобрать
+  // сценарий не получилось
+  static bool Parse(std::istream &in, std::vector<Step> *steps,
+                    int *bad_line = nullptr);
+
+private:
+  static bool ParseLine(const std::string &line, std::vector<Step> *steps,
+                        bool *in_batch);
+  // внутри begin/end запрос добавляется в текущий пакет
+  static void Push(const UserQuery &query, std::vector<Step> *steps,
+                   bool in_batch);
+};
+
+} // namespace DSViz
+#endif // SCRIPT_H
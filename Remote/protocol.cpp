@@ -0,0 +1,266 @@
+#include "Remote/protocol.h"
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <memory>
+
+namespace DSViz {
+
+namespace detail {
+
+// чтение little endian чисел из тела. После первой нехватки байт все
+// следующие чтения тоже неудачные, так что проверять можно один раз в конце
+class Wire::Reader {
+public:
+  Reader(const char *data, size_t size) : data_{data}, size_{size} {}
+
+  uint32_t U32() {
+    if (!take(4)) {
+      return 0;
+    }
+    auto p = reinterpret_cast<const unsigned char *>(data_ + pos_ - 4);
+    return uint32_t{p[0]} | uint32_t{p[1]} << 8 | uint32_t{p[2]} << 16 |
+           uint32_t{p[3]} << 24;
+  }
+
+  uint8_t U8() {
+    return take(1) ? static_cast<uint8_t>(data_[pos_ - 1]) : 0;
+  }
+
+  int I32() { return static_cast<int>(U32()); }
+
+  double F64() {
+    uint64_t bits = U32();
+    bits |= uint64_t{U32()} << 32;
+    double value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+  }
+
+  // счетчик элементов: каждому нужно хотя бы size байт, так что большее
+  // число - заведомо мусор, и память под него выделять не надо
+  bool Count(size_t size, uint32_t *count) {
+    *count = U32();
+    return ok_ && *count <= (size_ - pos_) / size;
+  }
+
+  bool Ok() const { return ok_; }
+  bool End() const { return ok_ && pos_ == size_; }
+
+private:
+  bool take(size_t count) {
+    if (!ok_ || size_ - pos_ < count) {
+      ok_ = false;
+      return false;
+    }
+    pos_ += count;
+    return true;
+  }
+
+  const char *data_;
+  size_t size_;
+  size_t pos_ = {};
+  bool ok_ = true;
+};
+
+void Wire::put(uint32_t value, std::string *out) {
+  char bytes[4] = {static_cast<char>(value), static_cast<char>(value >> 8),
+                   static_cast<char>(value >> 16),
+                   static_cast<char>(value >> 24)};
+  out->append(bytes, sizeof(bytes));
+}
+
+void Wire::seal(size_t start, std::string *out) {
+  auto size = static_cast<uint32_t>(out->size() - start - kHeader);
+  for (size_t i = 0; i < kHeader; ++i) {
+    (*out)[start + i] = static_cast<char>(size >> (8 * i));
+  }
+}
+
+void Wire::Encode(const Request &request, std::string *out) {
+  size_t start = out->size();
+  put(0, out);
+  out->push_back(static_cast<char>(request.kind));
+  put(request.seq, out);
+  if (request.kind == Request::Kind::query) {
+    put_query(request.query, false, out);
+  }
+  seal(start, out);
+}
+
+void Wire::Encode(const Reply &reply, std::string *out) {
+  size_t start = out->size();
+  put(0, out);
+  out->push_back(static_cast<char>(reply.kind));
+  put(reply.seq, out);
+  put(static_cast<uint32_t>(reply.code), out);
+  put(static_cast<uint32_t>(reply.results.size()), out);
+  for (auto code : reply.results) {
+    put(static_cast<uint32_t>(code), out);
+  }
+  put(static_cast<uint32_t>(reply.values.size()), out);
+  for (auto value : reply.values) {
+    put(static_cast<uint32_t>(value), out);
+  }
+  seal(start, out);
+}
+
+void Wire::put_query(const UserQuery &query, bool nested, std::string *out) {
+  out->push_back(static_cast<char>(query.type));
+  put(static_cast<uint32_t>(query.args.first), out);
+  put(static_cast<uint32_t>(query.args.second), out);
+  put(static_cast<uint32_t>(query.range.first), out);
+  put(static_cast<uint32_t>(query.range.second), out);
+  put(static_cast<uint32_t>(query.sample), out);
+  if (query.type == QueryType::policy) {
+    out->push_back(static_cast<char>(query.policy.kind));
+    put(static_cast<uint32_t>(query.policy.depth), out);
+    uint64_t bits;
+    std::memcpy(&bits, &query.policy.probability, sizeof(bits));
+    put(static_cast<uint32_t>(bits), out);
+    put(static_cast<uint32_t>(bits >> 32), out);
+  }
+  if (query.type == QueryType::load) {
+    size_t count = query.keys ? query.keys->size() : 0;
+    put(static_cast<uint32_t>(count), out);
+    for (size_t i = 0; i < count; ++i) {
+      put(static_cast<uint32_t>((*query.keys)[i]), out);
+    }
+  }
+  if (query.type == QueryType::batch && !nested) {
+    put(static_cast<uint32_t>(query.batch.size()), out);
+    for (auto &item : query.batch) {
+      put_query(item, true, out);
+    }
+  }
+}
+
+bool Wire::get_query(Reader *reader, bool nested, UserQuery *query) {
+  auto type = reader->U8();
+  if (type >= static_cast<uint8_t>(QueryType::do_nothing) ||
+      (nested && type == static_cast<uint8_t>(QueryType::batch))) {
+    return false;
+  }
+  query->type = static_cast<QueryType>(type);
+  query->args.first = reader->I32();
+  query->args.second = reader->I32();
+  query->range.first = reader->I32();
+  query->range.second = reader->I32();
+  query->sample = reader->I32();
+
+  if (query->type == QueryType::policy) {
+    auto kind = reader->U8();
+    query->policy.depth = reader->I32();
+    query->policy.probability = reader->F64();
+    // те же ограничения, что и у SplayPolicy::Parse
+    if (kind > static_cast<uint8_t>(SplayPolicy::Kind::none) ||
+        query->policy.depth < 0 || !(query->policy.probability >= 0) ||
+        query->policy.probability > 1) {
+      return false;
+    }
+    query->policy.kind = static_cast<SplayPolicy::Kind>(kind);
+  }
+  if (query->type == QueryType::load) {
+    uint32_t count;
+    if (!reader->Count(sizeof(int32_t), &count)) {
+      return false;
+    }
+    auto keys = std::make_shared<std::vector<int>>(count);
+    for (auto &key : *keys) {
+      key = reader->I32();
+    }
+    // Model::Load верит, что ключи уже упорядочены
+    if (std::adjacent_find(keys->begin(), keys->end(),
+                           std::greater_equal<int>{}) != keys->end()) {
+      return false;
+    }
+    query->keys = std::move(keys);
+  }
+  if (query->type == QueryType::batch) {
+    uint32_t count;
+    // самый короткий запрос - 21 байт
+    if (!reader->Count(21, &count)) {
+      return false;
+    }
+    query->batch.resize(count, UserQuery{QueryType::do_nothing, {0, 0}});
+    for (auto &item : query->batch) {
+      if (!get_query(reader, true, &item)) {
+        return false;
+      }
+    }
+  }
+  return reader->Ok();
+}
+
+bool Wire::Decode(const char *data, size_t size, Request *request) {
+  Reader reader{data, size};
+  auto kind = reader.U8();
+  if (kind > static_cast<uint8_t>(Request::Kind::unsubscribe)) {
+    return false;
+  }
+  request->kind = static_cast<Request::Kind>(kind);
+  request->seq = reader.U32();
+  if (request->kind == Request::Kind::query &&
+      !get_query(&reader, false, &request->query)) {
+    return false;
+  }
+  return reader.End();
+}
+
+bool Wire::Decode(const char *data, size_t size, Reply *reply) {
+  Reader reader{data, size};
+  auto kind = reader.U8();
+  if (kind > static_cast<uint8_t>(Reply::Kind::bad_request)) {
+    return false;
+  }
+  reply->kind = static_cast<Reply::Kind>(kind);
+  reply->seq = reader.U32();
+  auto valid = [](uint32_t code) {
+    return code <= static_cast<uint32_t>(MsgCode::empty_msg);
+  };
+  auto code = reader.U32();
+  if (!valid(code)) {
+    return false;
+  }
+  reply->code = static_cast<MsgCode>(code);
+  uint32_t count;
+  if (!reader.Count(sizeof(int32_t), &count)) {
+    return false;
+  }
+  reply->results.resize(count);
+  for (auto &result : reply->results) {
+    code = reader.U32();
+    if (!valid(code)) {
+      return false;
+    }
+    result = static_cast<MsgCode>(code);
+  }
+  if (!reader.Count(sizeof(int32_t), &count)) {
+    return false;
+  }
+  reply->values.resize(count);
+  for (auto &value : reply->values) {
+    value = reader.I32();
+  }
+  return reader.End();
+}
+
+bool Wire::Next(const char *data, size_t size, size_t *body) {
+  *body = 0;
+  if (size < kHeader) {
+    return true;
+  }
+  Reader reader{data, kHeader};
+  auto length = reader.U32();
+  if (length == 0 || length > kMaxMessage) {
+    return false;
+  }
+  if (size - kHeader >= length) {
+    *body = length;
+  }
+  return true;
+}
+
+} // namespace detail
+
+} // namespace DSViz
@@ -0,0 +1,91 @@
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+#include "Common/node.h"
+#include "Common/query.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace DSViz {
+
+// двоичный протокол для управления моделью из другого процесса (см. Server).
+// Каждое сообщение - это u32 длина и столько байт тела, все числа little
+// endian. Тело запроса:
+//
+//   u8 kind (0 - запрос, 1 - подписаться на кадры, 2 - отписаться)
+//   u32 seq - номер, который клиент выбирает сам, он вернется в ответе
+//   дальше только для kind = 0 - сам запрос:
+//     u8 type (QueryType), i32 args.first, i32 args.second,
+//     i32 range.first, i32 range.second, i32 sample
+//     policy: u8 kind, i32 depth, f64 probability
+//     load: u32 n, n x i32 ключей (по возрастанию без повторов)
+//     batch: u32 n, n запросов в том же виде (пакет в пакете нельзя)
+//
+// тело ответа:
+//
+//   u8 kind (0 - ответ на запрос, 1 - кадр по подписке, 2 - запрос не разобран)
+//   u32 seq (у кадра 0)
+//   i32 code (MsgCode итогового кадра запроса)
+//   u32 n, n x i32 - Frame::results
+//   u32 n, n x i32 - Frame::values
+//
+// запросы можно слать, не дожидаясь ответов: они выполняются и отвечаются по
+// порядку, а кадры по подписке приходят между ответами в том порядке, в каком
+// их отправила модель
+namespace detail {
+
+class Wire {
+public:
+  using UserQuery = UserQuery<int>;
+
+  struct Request {
+    enum class Kind : uint8_t { query, subscribe, unsubscribe };
+
+    Kind kind = Kind::query;
+    uint32_t seq = 0;
+    UserQuery query = {QueryType::do_nothing, {0, 0}};
+  };
+
+  struct Reply {
+    enum class Kind : uint8_t { reply, frame, bad_request };
+
+    Kind kind = Kind::reply;
+    uint32_t seq = 0;
+    MsgCode code = MsgCode::empty_msg;
+    std::vector<MsgCode> results = {};
+    std::vector<int> values = {};
+  };
+
+  // длина сообщения и тело целиком дописываются в конец out
+  static void Encode(const Request &request, std::string *out);
+  static void Encode(const Reply &reply, std::string *out);
+
+  // разбирают тело без длины. false, если тело обрезано, в нем лишние байты
+  // или недопустимые значения
+  static bool Decode(const char *data, size_t size, Request *request);
+  static bool Decode(const char *data, size_t size, Reply *reply);
+
+  // длина тела следующего сообщения в *body, если в буфере уже есть все его
+  // байты, иначе 0 (пустых тел не бывает). false - вместо длины мусор, и
+  // дальше поток читать нельзя
+  static bool Next(const char *data, size_t size, size_t *body);
+
+  static constexpr const size_t kHeader = sizeof(uint32_t);
+  // защита от мусора вместо длины
+  static constexpr const uint32_t kMaxMessage = uint32_t{256} << 20;
+
+private:
+  class Reader;
+
+  static void put(uint32_t value, std::string *out);
+  static void put_query(const UserQuery &query, bool nested, std::string *out);
+  static bool get_query(Reader *reader, bool nested, UserQuery *query);
+  // вписывает длину тела, которое начинается с start
+  static void seal(size_t start, std::string *out);
+};
+
+} // namespace detail
+
+} // namespace DSViz
+#endif // PROTOCOL_H
@@ -0,0 +1,191 @@
+#include "Remote/server.h"
+#include "Debug/log.h"
+#include <cstring>
+#include <vector>
+
+namespace DSViz {
+
+auto Server::GetCallback() {
+  return [this](const MsgType &msg) { HandleMsg(msg); };
+}
+
+Server::Server(Model *model)
+    : model_{model}, controller_{model}, port_in_{GetCallback()} {
+  // как и во View: сначала пустой запрос, чтобы контроллер при подписке
+  // ничего не выполнил
+  port_out_.Set(UserQuery{QueryType::do_nothing, {0, 0}});
+  port_out_.Subscribe(controller_.GetPortIn());
+  model->SubscribeToBareTree(&port_in_);
+  QObject::connect(&server_, &QLocalServer::newConnection, this,
+                   &Server::OnConnection);
+}
+
+Server::~Server() { server_.close(); }
+
+bool Server::Listen(const QString &name) {
+  QLocalServer::removeServer(name);
+  return server_.listen(name);
+}
+
+QString Server::ErrorString() const { return server_.errorString(); }
+
+QString Server::Option(int argc, char *argv[], const char *option) {
+  for (int i = 1; i + 1 < argc; ++i) {
+    if (std::strcmp(argv[i], option) == 0) {
+      return QString::fromLocal8Bit(argv[i + 1]);
+    }
+  }
+  return {};
+}
+
+void Server::OnConnection() {
+  while (auto socket = server_.nextPendingConnection()) {
+    clients_[socket] = Client{};
+    QObject::connect(socket, &QLocalSocket::readyRead, this,
+                     &Server::OnReadyRead);
+    QObject::connect(socket, &QLocalSocket::bytesWritten, this,
+                     &Server::OnBytesWritten);
+    QObject::connect(socket, &QLocalSocket::disconnected, this,
+                     &Server::OnDisconnected);
+    DSVIZ_LOG(info, "remote client connected, {} total", clients_.size());
+  }
+}
+
+void Server::OnReadyRead() {
+  auto socket = qobject_cast<QLocalSocket *>(sender());
+  auto it = clients_.find(socket);
+  if (it == clients_.end()) {
+    return;
+  }
+  it->second.in += socket->readAll();
+  if (!parse(&it->second)) {
+    // вместо длины мусор: где начинается следующее сообщение, уже не понять
+    DSVIZ_LOG(warn, "remote client sent a broken frame, dropping it");
+    socket->abort();
+    return;
+  }
+  drain();
+}
+
+// клиент, у которого скопились непрочитанные ответы, ждал, пока они уйдут
+void Server::OnBytesWritten() { drain(); }
+
+void Server::Resume() { drain(); }
+
+void Server::OnDisconnected() {
+  auto socket = qobject_cast<QLocalSocket *>(sender());
+  clients_.erase(socket);
+  socket->deleteLater();
+  DSVIZ_LOG(info, "remote client disconnected, {} left", clients_.size());
+}
+
+bool Server::parse(Client *client) {
+  size_t pos = 0;
+  size_t size = static_cast<size_t>(client->in.size());
+  const char *data = client->in.constData();
+  while (true) {
+    size_t body;
+    if (!Wire::Next(data + pos, size - pos, &body)) {
+      return false;
+    }
+    if (body == 0) {
+      break;
+    }
+    Pending pending;
+    pending.bad = !Wire::Decode(data + pos + Wire::kHeader, body,
+                                &pending.request);
+    client->pending.push_back(std::move(pending));
+    pos += Wire::kHeader + body;
+  }
+  client->in.remove(0, static_cast<int>(pos));
+  return true;
+}
+
+// по одному запросу от каждого клиента за круг, чтобы один быстрый
+// генератор не занимал модель целиком
+void Server::drain() {
+  // запрос окна еще идет, а контроллер запрос посреди чужой операции просто
+  // отбросит (см. Model::Busy)
+  if (draining_ || model_->Busy()) {
+    return;
+  }
+  draining_ = true;
+  for (bool progress = true; progress;) {
+    progress = false;
+    // пока выполняется запрос, клиенты могут отключиться, так что беру копию
+    std::vector<QPointer<QLocalSocket>> sockets;
+    for (auto &entry : clients_) {
+      sockets.push_back(entry.first);
+    }
+    for (auto &socket : sockets) {
+      auto it = socket ? clients_.find(socket.data()) : clients_.end();
+      if (it == clients_.end() || it->second.pending.empty() ||
+          socket->bytesToWrite() >= kMaxBacklog) {
+        continue;
+      }
+      auto pending = std::move(it->second.pending.front());
+      it->second.pending.pop_front();
+      execute(socket, pending);
+      progress = true;
+    }
+  }
+  draining_ = false;
+}
+
+void Server::execute(const QPointer<QLocalSocket> &socket,
+                     const Pending &pending) {
+  Wire::Reply reply;
+  reply.seq = pending.request.seq;
+  if (pending.bad) {
+    reply.kind = Wire::Reply::Kind::bad_request;
+  } else if (pending.request.kind == Wire::Request::Kind::query) {
+    reply_ = Wire::Reply{};
+    executing_ = true;
+    emit Executing(true);
+    port_out_.Set(pending.request.query);
+    emit Executing(false);
+    executing_ = false;
+    reply.code = reply_.code;
+    reply.results = std::move(reply_.results);
+    reply.values = std::move(reply_.values);
+  } else {
+    clients_[socket.data()].subscribed =
+        pending.request.kind == Wire::Request::Kind::subscribe;
+  }
+  // пока шел запрос, клиент мог отключиться
+  if (!socket || clients_.find(socket.data()) == clients_.end()) {
+    return;
+  }
+  std::string bytes;
+  Wire::Encode(reply, &bytes);
+  socket->write(bytes.data(), static_cast<qint64>(bytes.size()));
+}
+
+void Server::HandleMsg(const MsgType &msg) {
+  if (msg.code == MsgCode::empty_msg) {
+    return;
+  }
+  if (executing_) {
+    reply_.code = msg.code;
+    reply_.results = msg.results;
+    reply_.values = msg.values;
+  }
+  std::string bytes;
+  for (auto &[socket, client] : clients_) {
+    // медленному подписчику кадры не копятся, а пропускаются
+    if (!client.subscribed || socket->bytesToWrite() >= kMaxBacklog) {
+      continue;
+    }
+    if (bytes.empty()) {
+      Wire::Reply frame;
+      frame.kind = Wire::Reply::Kind::frame;
+      frame.code = msg.code;
+      frame.results = msg.results;
+      frame.values = msg.values;
+      Wire::Encode(frame, &bytes);
+    }
+    socket->write(bytes.data(), static_cast<qint64>(bytes.size()));
+  }
+}
+
+} // namespace DSViz
@@ -0,0 +1,109 @@
+#ifndef SERVER_H
+#define SERVER_H
+#include "Common/query.h"
+#include "Core/controller.h"
+#include "Core/frame.h"
+#include "Core/model.h"
+#include "Observer/observer.h"
+#include "Remote/protocol.h"
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QObject>
+#include <QPointer>
+#include <deque>
+#include <map>
+#include <string>
+
+namespace DSViz {
+
+// локальный сокет (на linux - unix domain socket), через который модель
+// можно гонять из другого процесса на той же машине, например из своего
+// генератора нагрузки. Протокол см. в Wire.
+//
+// у сервера свой Controller над той же моделью, так что запросы идут мимо
+// View. Ответ на запрос - это итоговый кадр модели: его код, результаты
+// пакета и values. Если рядом открыто окно, оно по-прежнему рисует каждый
+// кадр (и ждет delay), так что для полной скорости запросы лучше слать
+// пакетами или запускать без окна (--serve)
+class Server : public QObject {
+  Q_OBJECT
+
+  using Wire = detail::Wire;
+  using MsgType = Frame;
+  using UserQuery = UserQuery<int>;
+
+  auto GetCallback();
+
+public:
+  explicit Server(Model *model);
+  ~Server();
+
+  // старый файл сокета с тем же именем (после падения) удаляется
+  bool Listen(const QString &name);
+  QString ErrorString() const;
+
+  // значение аргумента option (--listen, --serve) или пустая строка.
+  // Смотрит в argv до создания приложения, как HeadlessRunner::Requested
+  static QString Option(int argc, char *argv[], const char *option);
+
+  // сколько байт ответов может висеть на клиенте, пока он их не читает. Пока
+  // больше, его запросы не выполняются, а кадры по подписке ему не шлются
+  static constexpr const qint64 kMaxBacklog = qint64{64} << 20;
+
+signals:
+  // запрос клиента начал/закончил выполняться. Рядом может быть окно: оно
+  // рисует кадры запроса с анимацией и на это время выключает свои кнопки
+  void Executing(bool running);
+
+public slots:
+  // модель освободилась (окно закончило свой запрос): выполняет то, что
+  // клиенты прислали за это время
+  void Resume();
+
+private slots:
+  void OnConnection();
+  void OnReadyRead();
+  void OnBytesWritten();
+  void OnDisconnected();
+
+private:
+  struct Pending {
+    Wire::Request request;
+    // тело не разобралось, в ответ уйдет bad_request
+    bool bad;
+  };
+
+  struct Client {
+    QByteArray in;
+    // разобранные, но еще не выполненные запросы
+    std::deque<Pending> pending;
+    bool subscribed = false;
+  };
+
+  void HandleMsg(const MsgType &msg);
+  // разбирает все целые сообщения из буфера клиента
+  bool parse(Client *client);
+  // выполняет накопленные запросы всех клиентов по очереди. Если модель
+  // занята (окно крутит цикл событий посреди своей анимации), запросы ждут
+  // Resume
+  void drain();
+  void execute(const QPointer<QLocalSocket> &socket, const Pending &pending);
+
+  Model *model_;
+  Controller controller_;
+  QLocalServer server_;
+  std::map<QLocalSocket *, Client> clients_;
+  // drain уже идет: во время кадра окно может крутить свой цикл событий
+  // (delay), и тогда новые запросы только встают в очередь
+  bool draining_ = {};
+
+  // итоговый кадр выполняемого запроса
+  bool executing_ = {};
+  Wire::Reply reply_ = {};
+
+  Observer<MsgType> port_in_;
+  Observable<UserQuery> port_out_;
+};
+
+} // namespace DSViz
+#endif // SERVER_H
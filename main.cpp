@@ -1,8 +1,83 @@
 #include "App/app.h"
+#include "Core/reclaimer.h"
+#include "Debug/log.h"
+#include "Debug/perf.h"
+#include "Headless/runner.h"
+#include "Remote/server.h"
 #include <QApplication>
+#include <QCoreApplication>
+#include <QGuiApplication>
+#include <iostream>
+#include <memory>
 
 int main(int argc, char *argv[]) {
+  // DSVIZ_LOG=путь включает лог, какие записи в него попадут, решается при
+  // сборке (DSVIZ_LOG_LEVEL)
+  if (!qEnvironmentVariableIsEmpty("DSVIZ_LOG")) {
+    DSViz::Logger::Options options;
+    options.path = qEnvironmentVariable("DSVIZ_LOG").toStdString();
+    DSViz::Logger::Instance().Start(options);
+  }
+  if (DSViz::HeadlessRunner::Requested(argc, argv)) {
+    // на серверах без дисплея окно все равно не создать
+    if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM")) {
+      qputenv("QT_QPA_PLATFORM", "offscreen");
+    }
+    QGuiApplication qapp(argc, argv);
+    DSViz::HeadlessRunner::Options options;
+    if (!DSViz::HeadlessRunner::ParseOptions(qapp.arguments(), &options)) {
+      return 1;
+    }
+    DSViz::HeadlessRunner runner{options};
+    int code = runner.Run();
+    DSViz::Reclaimer::Instance().Abandon();
+    DSViz::Logger::Instance().Stop();
+    return code;
+  }
+  // DSVIZ_PROFILE=1 (или splay - еще и по каждому splay): счетчики процессора
+  // по операциям, таблица печатается при выходе. В headless режиме вместо
+  // этого --profile
+  std::unique_ptr<DSViz::Profiler> profiler;
+  if (!qEnvironmentVariableIsEmpty("DSVIZ_PROFILE")) {
+    DSViz::Profiler::Options options;
+    options.splays = qEnvironmentVariable("DSVIZ_PROFILE") == "splay";
+    profiler = std::make_unique<DSViz::Profiler>(options);
+  }
+  auto report = [&profiler] {
+    if (profiler) {
+      std::cerr << profiler->Report();
+    }
+  };
+  // --serve <имя>: только модель и локальный сокет, без окна и без кадров
+  auto serve = DSViz::Server::Option(argc, argv, "--serve");
+  if (!serve.isEmpty()) {
+    QCoreApplication qapp(argc, argv);
+    DSViz::Model model;
+    model.SetProfiler(profiler.get());
+    DSViz::Server server{&model};
+    if (!server.Listen(serve)) {
+      std::cerr << "Can't listen on " << serve.toStdString() << ": "
+                << server.ErrorString().toStdString() << "\n";
+      return 1;
+    }
+    int code = qapp.exec();
+    report();
+    DSViz::Reclaimer::Instance().Abandon();
+    DSViz::Logger::Instance().Stop();
+    return code;
+  }
   QApplication qapp(argc, argv);
   DSViz::App app{};
-  return qapp.exec();
+  app.Profile(profiler.get());
+  // --listen <имя>: то же, но рядом с окном, которое рисует кадры
+  auto listen = DSViz::Server::Option(argc, argv, "--listen");
+  if (!listen.isEmpty() && !app.Listen(listen)) {
+    std::cerr << "Can't listen on " << listen.toStdString() << "\n";
+  }
+  int code = qapp.exec();
+  report();
+  // дальше разрушаются модели, их деревья освобождать по вершине незачем
+  DSViz::Reclaimer::Instance().Abandon();
+  DSViz::Logger::Instance().Stop();
+  return code;
 }